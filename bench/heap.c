@@ -0,0 +1,250 @@
+/* threadless.io
+ * Copyright (c) 2016 Justin R. Cutler
+ * Licensed under the MIT License. See LICENSE file in the project root for
+ * full license information.
+ */
+/** @file
+ * heap vs. type-specialized heap vs. d-ary keyed heap benchmark
+ * @author Justin R. Cutler <justin.r.cutler@gmail.com>
+ *
+ * Usage: bench-heap [count...] (default: 1000 100000 10000000)
+ *
+ * For each count, measures filling a heap with pseudo-random keys, "hold"
+ * operations (pop the best node, push it back with a later key) and draining
+ * the heap. Build with @c -DCMAKE_BUILD_TYPE=Release for meaningful results.
+ */
+
+/* clock_gettime, CLOCK_MONOTONIC */
+#define _POSIX_C_SOURCE 200809L
+
+/* printf, perror */
+#include <stdio.h>
+/* EXIT_SUCCESS, EXIT_FAILURE, strtoul */
+#include <stdlib.h>
+/* uint64_t */
+#include <stdint.h>
+/* clock_gettime, struct timespec */
+#include <time.h>
+
+/* container_of */
+#include <threadless/container_of.h>
+/* default_allocator_get */
+#include <threadless/default_allocator.h>
+/* heap_* */
+#include <threadless/heap.h>
+/* THREADLESS_HEAP_DEFINE */
+#include <threadless/heap_define.h>
+/* dheap_* */
+#include <threadless/dheap.h>
+
+
+typedef struct {
+    heap_node_t node;
+    uint64_t key;
+} value_t;
+
+
+static uint64_t xorshift64(uint64_t *state)
+{
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *state = x;
+}
+
+
+static double now(void)
+{
+    struct timespec ts;
+    (void) clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+
+static void report(const char *name, size_t count, const double *t)
+{
+    printf("%-6s %9zu  push %7.1f ns  hold %7.1f ns  pop %7.1f ns\n", name,
+        count, (t[1] - t[0]) / count, (t[2] - t[1]) / count,
+        (t[3] - t[2]) / count);
+}
+
+
+static int min_compare(const heap_node_t *a, const heap_node_t *b)
+{
+    uint64_t ka = container_of(a, const value_t, node)->key;
+    uint64_t kb = container_of(b, const value_t, node)->key;
+    return (ka > kb) - (ka < kb);
+}
+
+
+static int bench_heap(allocator_t *allocator, size_t count)
+{
+    int error;
+    allocation_t alloc;
+    value_t *values;
+    heap_t heap;
+    uint64_t state = 88172645463325252ULL;
+    double t[4];
+    size_t i;
+
+    allocation_init(&alloc, allocator);
+    error = allocation_realloc_array(&alloc, count, sizeof(*values));
+    if (error) {
+        return error;
+    }
+    values = alloc.memory;
+    heap_init(&heap, allocator, min_compare);
+
+    t[0] = now();
+    for (i = 0; !error && i < count; ++i) {
+        values[i].key = xorshift64(&state) >> 16;
+        error = heap_push(&heap, &(values[i].node));
+    }
+    t[1] = now();
+    for (i = 0; !error && i < count; ++i) {
+        value_t *value = container_of(heap_pop(&heap), value_t, node);
+        value->key += xorshift64(&state) >> 40;
+        error = heap_push(&heap, &(value->node));
+    }
+    t[2] = now();
+    while (NULL != heap_pop(&heap)) {
+        /* drain */
+    }
+    t[3] = now();
+
+    if (!error) {
+        report("heap", count, t);
+    }
+
+    heap_fini(&heap);
+    allocation_free(&alloc);
+
+    return error;
+}
+
+
+#define value_compare(a, b) (((a)->key > (b)->key) - ((a)->key < (b)->key))
+THREADLESS_HEAP_DEFINE(value_heap, value_t, node, value_compare)
+
+
+static int bench_typed_heap(allocator_t *allocator, size_t count)
+{
+    int error;
+    allocation_t alloc;
+    value_t *values;
+    heap_t heap;
+    uint64_t state = 88172645463325252ULL;
+    double t[4];
+    size_t i;
+
+    allocation_init(&alloc, allocator);
+    error = allocation_realloc_array(&alloc, count, sizeof(*values));
+    if (error) {
+        return error;
+    }
+    values = alloc.memory;
+    value_heap_init(&heap, allocator);
+
+    t[0] = now();
+    for (i = 0; !error && i < count; ++i) {
+        values[i].key = xorshift64(&state) >> 16;
+        error = value_heap_push(&heap, &(values[i]));
+    }
+    t[1] = now();
+    for (i = 0; !error && i < count; ++i) {
+        value_t *value = value_heap_pop(&heap);
+        value->key += xorshift64(&state) >> 40;
+        error = value_heap_push(&heap, value);
+    }
+    t[2] = now();
+    while (NULL != value_heap_pop(&heap)) {
+        /* drain */
+    }
+    t[3] = now();
+
+    if (!error) {
+        report("theap", count, t);
+    }
+
+    heap_fini(&heap);
+    allocation_free(&alloc);
+
+    return error;
+}
+
+
+static int bench_dheap(allocator_t *allocator, size_t count)
+{
+    int error;
+    allocation_t alloc;
+    dheap_node_t *nodes;
+    dheap_t heap;
+    uint64_t state = 88172645463325252ULL;
+    double t[4];
+    size_t i;
+
+    allocation_init(&alloc, allocator);
+    error = allocation_realloc_array(&alloc, count, sizeof(*nodes));
+    if (error) {
+        return error;
+    }
+    nodes = alloc.memory;
+    dheap_init(&heap, allocator);
+
+    t[0] = now();
+    for (i = 0; !error && i < count; ++i) {
+        error = dheap_push(&heap, &(nodes[i]), xorshift64(&state) >> 16);
+    }
+    t[1] = now();
+    for (i = 0; !error && i < count; ++i) {
+        dheap_node_t *node = dheap_peek(&heap);
+        uint64_t key = dheap_key(node) + (xorshift64(&state) >> 40);
+        (void) dheap_pop(&heap);
+        error = dheap_push(&heap, node, key);
+    }
+    t[2] = now();
+    while (NULL != dheap_pop(&heap)) {
+        /* drain */
+    }
+    t[3] = now();
+
+    if (!error) {
+        report("dheap", count, t);
+    }
+
+    dheap_fini(&heap);
+    allocation_free(&alloc);
+
+    return error;
+}
+
+
+int main(int argc, char *argv[])
+{
+    static const size_t default_counts[] = { 1000, 100000, 10000000 };
+    allocator_t *allocator = default_allocator_get();
+    int error = 0;
+    int i;
+    int n = (argc > 1) ? argc - 1 : 3;
+
+    for (i = 0; !error && i < n; ++i) {
+        size_t count = (argc > 1) ? strtoul(argv[i + 1], NULL, 0) :
+            default_counts[i];
+        error = bench_heap(allocator, count);
+        if (!error) {
+            error = bench_typed_heap(allocator, count);
+        }
+        if (!error) {
+            error = bench_dheap(allocator, count);
+        }
+    }
+
+    if (error) {
+        perror("bench-heap");
+    }
+
+    allocator_destroy(allocator);
+
+    return !error ? EXIT_SUCCESS : EXIT_FAILURE;
+}
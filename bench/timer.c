@@ -0,0 +1,173 @@
+/* threadless.io
+ * Copyright (c) 2016 Justin R. Cutler
+ * Licensed under the MIT License. See LICENSE file in the project root for
+ * full license information.
+ */
+/** @file
+ * heap vs. hierarchical timing wheel timer queue benchmark
+ * @author Justin R. Cutler <justin.r.cutler@gmail.com>
+ *
+ * Usage: bench-timer [count...] (default: 1000 100000 1000000)
+ *
+ * For each count, simulates that many idle connections, each with a 30s idle
+ * timeout: adding the timers, then a refresh-heavy trace (each "packet"
+ * refreshes a pseudo-random connection's timeout, with virtual time advancing
+ * 1us per packet and expiry checked every 1000 packets), then cancelling all
+ * timers. Build with @c -DCMAKE_BUILD_TYPE=Release for meaningful results.
+ */
+
+/* clock_gettime, CLOCK_MONOTONIC */
+#define _POSIX_C_SOURCE 200809L
+
+/* printf, perror */
+#include <stdio.h>
+/* EXIT_SUCCESS, EXIT_FAILURE, strtoul */
+#include <stdlib.h>
+/* uint64_t */
+#include <stdint.h>
+/* clock_gettime, struct timespec */
+#include <time.h>
+
+/* allocation_init, allocation_realloc_array, allocation_free */
+#include <threadless/allocation.h>
+/* default_allocator_get */
+#include <threadless/default_allocator.h>
+/* timer_heap_create */
+#include <threadless/timer_heap.h>
+/* timer_wheel_create */
+#include <threadless/timer_wheel.h>
+/* timer_queue_* */
+#include <threadless/timer_queue.h>
+
+
+enum {
+    /** number of refreshes per connection */
+    REFRESHES = 10,
+    /** number of refreshes between expiry checks */
+    EXPIRE_INTERVAL = 1000,
+};
+
+
+/** idle timeout (nanoseconds) */
+#define IDLE_TIMEOUT 30000000000ULL
+/** virtual time between packets (nanoseconds) */
+#define PACKET_INTERVAL 1000ULL
+
+
+static size_t expired;
+
+
+static uint64_t xorshift64(uint64_t *state)
+{
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *state = x;
+}
+
+
+static double now(void)
+{
+    struct timespec ts;
+    (void) clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+
+static void idle_timeout(timer_event_t *timer)
+{
+    (void) timer;
+    expired++;
+}
+
+
+static int bench(const char *name, timer_queue_t *queue,
+    allocator_t *allocator, size_t count)
+{
+    int error;
+    allocation_t alloc;
+    timer_event_t *timers;
+    uint64_t state = 88172645463325252ULL;
+    uint64_t time = 0;
+    size_t refreshes = count * REFRESHES;
+    double t[4];
+    size_t i;
+
+    if (NULL == queue) {
+        return -1;
+    }
+    allocation_init(&alloc, allocator);
+    error = allocation_realloc_array(&alloc, count, sizeof(*timers));
+    if (error) {
+        timer_queue_destroy(queue);
+        return error;
+    }
+    timers = alloc.memory;
+    expired = 0;
+
+    t[0] = now();
+    for (i = 0; !error && i < count; ++i) {
+        timer_init(&(timers[i]), idle_timeout);
+        error = timer_queue_add(queue, &(timers[i]), time + IDLE_TIMEOUT);
+    }
+    t[1] = now();
+    for (i = 0; !error && i < refreshes; ++i) {
+        timer_event_t *timer = &(timers[xorshift64(&state) % count]);
+        time += PACKET_INTERVAL;
+        if (timer_pending(timer)) {
+            error = timer_queue_refresh(timer, time + IDLE_TIMEOUT);
+        } else {
+            /* reconnect after timeout */
+            error = timer_queue_add(queue, timer, time + IDLE_TIMEOUT);
+        }
+        if (0 == i % EXPIRE_INTERVAL) {
+            (void) timer_queue_expire(queue, time);
+        }
+    }
+    t[2] = now();
+    for (i = 0; i < count; ++i) {
+        timer_queue_cancel(&(timers[i]));
+    }
+    t[3] = now();
+
+    if (!error) {
+        printf("%-6s %9zu  add %7.1f ns  refresh %7.1f ns  cancel %7.1f ns"
+            "  (%zu expired)\n", name, count, (t[1] - t[0]) / count,
+            (t[2] - t[1]) / refreshes, (t[3] - t[2]) / count, expired);
+    }
+
+    timer_queue_destroy(queue);
+    allocation_free(&alloc);
+
+    return error;
+}
+
+
+int main(int argc, char *argv[])
+{
+    static const size_t default_counts[] = { 1000, 100000, 1000000 };
+    allocator_t *allocator = default_allocator_get();
+    int error = 0;
+    int i;
+    int n = (argc > 1) ? argc - 1 : 3;
+
+    for (i = 0; !error && i < n; ++i) {
+        size_t count = (argc > 1) ? strtoul(argv[i + 1], NULL, 0) :
+            default_counts[i];
+        error = bench("heap", timer_heap_create(allocator), allocator, count);
+        if (!error) {
+            /* 1ms ticks */
+            error = bench("wheel", timer_wheel_create(allocator, 0),
+                allocator, count);
+        }
+    }
+
+    if (error) {
+        perror("bench-timer");
+    }
+
+    allocator_destroy(allocator);
+
+    return !error ? EXIT_SUCCESS : EXIT_FAILURE;
+}
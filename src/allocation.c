@@ -8,7 +8,7 @@
  * @author Justin R. Cutler <justin.r.cutler@gmail.com>
  */
 
-/* errno, ENOMEM */
+/* errno, EINVAL, ENOMEM */
 #include <errno.h>
 /* size_t, NULL */
 #include <stddef.h>
@@ -40,3 +40,30 @@ int allocation_realloc_array(allocation_t *allocation, size_t nmemb,
     /* perform allocator action */
     return allocation->allocator->allocate(allocation, alloc_size);
 }
+
+
+int allocation_realloc_aligned(allocation_t *allocation, size_t size,
+    size_t alignment)
+{
+    allocator_t *allocator = allocation->allocator;
+
+    if (0 == alignment || (alignment & (alignment - 1))) {
+        /* not a power of 2 */
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (0 == size) {
+        /* free (alignment is irrelevant) */
+        return allocator->allocate(allocation, 0);
+    }
+
+    if (NULL == allocator->aligned) {
+        /* aligned allocation not supported */
+        errno = EINVAL;
+        return -1;
+    }
+
+    /* perform allocator action */
+    return allocator->aligned(allocation, size, alignment);
+}
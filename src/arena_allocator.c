@@ -0,0 +1,302 @@
+/* threadless.io
+ * Copyright (c) 2016 Justin R. Cutler
+ * Licensed under the MIT License. See LICENSE file in the project root for
+ * full license information.
+ */
+/** @file
+ * arena (bump-pointer) allocator implementation
+ * @author Justin R. Cutler <justin.r.cutler@gmail.com>
+ */
+
+/* errno, ENOMEM */
+#include <errno.h>
+/* size_t, NULL */
+#include <stddef.h>
+/* uintptr_t */
+#include <stdint.h>
+/* memcpy */
+#include <string.h>
+
+/* allocation_init, allocation_realloc_array, allocation_free */
+#include <threadless/allocation.h>
+/* container_of */
+#include <threadless/container_of.h>
+/* ... */
+#include <threadless/arena_allocator.h>
+
+
+enum {
+    /** allocation alignment */
+    ARENA_ALIGN = 16,
+    /** default chunk size */
+    ARENA_CHUNK_SIZE = 64 * 1024,
+};
+
+
+typedef struct arena_chunk arena_chunk_t;
+struct arena_chunk {
+    /** memory containing this chunk */
+    allocation_t allocation;
+    /** previous (older) chunk */
+    arena_chunk_t *prev;
+    /** end of usable memory in this chunk */
+    char *end;
+};
+
+
+/** arena allocator instance */
+typedef struct {
+    /** allocator interface */
+    allocator_t allocator;
+    /** memory containing this instance */
+    allocation_t allocation;
+    /** chunk size */
+    size_t chunk_size;
+    /** current chunk */
+    arena_chunk_t *chunk;
+    /** next free byte in current chunk */
+    char *top;
+    /** most recent allocation in current chunk (if still live) */
+    char *last;
+} arena_t;
+
+
+static inline size_t align(size_t size)
+{
+    return (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+
+static inline char *chunk_start(arena_chunk_t *chunk)
+{
+    return (char *) chunk + align(sizeof(*chunk));
+}
+
+
+static arena_chunk_t *chunk_create(arena_t *arena, size_t size)
+{
+    arena_chunk_t *chunk;
+    size_t header = align(sizeof(*chunk));
+    allocation_t allocation;
+
+    if (header + size < size) {
+        /* integer overflow */
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    allocation_init(&allocation, arena->allocation.allocator);
+    if (allocation_realloc_array(&allocation, 1, header + size)) {
+        return NULL;
+    }
+
+    chunk = allocation.memory;
+    chunk->allocation = allocation;
+    chunk->end = (char *) chunk + header + size;
+
+    return chunk;
+}
+
+
+static void *bump(arena_t *arena, size_t size)
+{
+    size_t aligned = align(size);
+    arena_chunk_t *chunk = arena->chunk;
+    char *memory;
+
+    if (aligned < size) {
+        /* integer overflow */
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    if (NULL == chunk || (size_t)(chunk->end - arena->top) < aligned) {
+        if (aligned > (arena->chunk_size >> 1)) {
+            /* large allocation: dedicated chunk behind current chunk */
+            chunk = chunk_create(arena, aligned);
+            if (NULL == chunk) {
+                return NULL;
+            }
+            if (NULL != arena->chunk) {
+                chunk->prev = arena->chunk->prev;
+                arena->chunk->prev = chunk;
+            } else {
+                chunk->prev = NULL;
+                arena->chunk = chunk;
+                arena->top = chunk->end;
+                arena->last = NULL;
+            }
+            return chunk_start(chunk);
+        }
+
+        /* start a new chunk */
+        chunk = chunk_create(arena, arena->chunk_size);
+        if (NULL == chunk) {
+            return NULL;
+        }
+        chunk->prev = arena->chunk;
+        arena->chunk = chunk;
+        arena->top = chunk_start(chunk);
+    }
+
+    memory = arena->top;
+    arena->top += aligned;
+    arena->last = memory;
+
+    return memory;
+}
+
+
+static int arena_allocate(allocation_t *allocation, size_t size)
+{
+    arena_t *arena = container_of(allocation->allocator, arena_t, allocator);
+    char *memory = allocation->memory;
+    char *new_memory;
+
+    if (NULL != memory && memory == arena->last) {
+        /* most recent allocation: resize (or free) in place */
+        size_t aligned = align(size);
+        if (aligned >= size &&
+            (size_t)(arena->chunk->end - memory) >= aligned) {
+            arena->top = memory + aligned;
+            if (0 == size) {
+                arena->last = NULL;
+                memory = NULL;
+            }
+            allocation->memory = memory;
+            allocation->size = size;
+            return 0;
+        }
+    }
+
+    if (0 == size) {
+        /* free: no-op */
+        new_memory = NULL;
+    } else if (size <= allocation->size) {
+        /* shrink: no-op */
+        new_memory = memory;
+    } else {
+        new_memory = bump(arena, size);
+        if (NULL == new_memory) {
+            return -1;
+        }
+        if (NULL != memory) {
+            memcpy(new_memory, memory, allocation->size);
+        }
+    }
+
+    /* update allocation */
+    allocation->memory = new_memory;
+    allocation->size = size;
+
+    return 0;
+}
+
+
+static int arena_allocate_aligned(allocation_t *allocation, size_t size,
+    size_t alignment)
+{
+    arena_t *arena = container_of(allocation->allocator, arena_t, allocator);
+    char *memory = allocation->memory;
+    size_t padded = size + alignment - ARENA_ALIGN;
+    char *new_memory;
+    char *aligned;
+
+    if (alignment <= ARENA_ALIGN ||
+        (NULL != memory && size <= allocation->size &&
+            0 == ((uintptr_t) memory & (alignment - 1)))) {
+        /* natural alignment suffices, and shrinking never moves memory */
+        return arena_allocate(allocation, size);
+    }
+
+    if (padded < size) {
+        /* integer overflow */
+        errno = ENOMEM;
+        return -1;
+    }
+
+    /* over-allocate, then skip to alignment boundary */
+    new_memory = bump(arena, padded);
+    if (NULL == new_memory) {
+        return -1;
+    }
+    aligned = (char *) (((uintptr_t) new_memory + alignment - 1) &
+        ~(uintptr_t)(alignment - 1));
+    if (arena->last == new_memory) {
+        /* allow in-place resizing of aligned memory */
+        arena->last = aligned;
+    }
+
+    if (NULL != memory) {
+        memcpy(aligned, memory,
+            (allocation->size < size) ? allocation->size : size);
+    }
+
+    /* update allocation */
+    allocation->memory = aligned;
+    allocation->size = size;
+
+    return 0;
+}
+
+
+static void free_chunks(arena_chunk_t *chunk)
+{
+    while (NULL != chunk) {
+        allocation_t allocation = chunk->allocation;
+        chunk = chunk->prev;
+        allocation_free(&allocation);
+    }
+}
+
+
+static void arena_destroy(allocator_t *allocator)
+{
+    arena_t *arena = container_of(allocator, arena_t, allocator);
+    allocation_t allocation = arena->allocation;
+
+    free_chunks(arena->chunk);
+    allocation_free(&allocation);
+}
+
+
+allocator_t *arena_allocator_create(allocator_t *backing, size_t chunk_size)
+{
+    static const allocator_t arena_allocator = {
+        .allocate = arena_allocate,
+        .destroy = arena_destroy,
+        .aligned = arena_allocate_aligned,
+    };
+    arena_t *arena;
+    allocation_t allocation;
+
+    allocation_init(&allocation, backing);
+    if (allocation_realloc_array(&allocation, 1, sizeof(*arena))) {
+        return NULL;
+    }
+
+    arena = allocation.memory;
+    memcpy(&arena->allocator, &arena_allocator, sizeof(arena->allocator));
+    arena->allocation = allocation;
+    arena->chunk_size = chunk_size ? align(chunk_size) : ARENA_CHUNK_SIZE;
+    arena->chunk = NULL;
+    arena->top = NULL;
+    arena->last = NULL;
+
+    return &arena->allocator;
+}
+
+
+void arena_allocator_reset(allocator_t *allocator)
+{
+    arena_t *arena = container_of(allocator, arena_t, allocator);
+    arena_chunk_t *chunk = arena->chunk;
+
+    if (NULL != chunk) {
+        /* keep current chunk, release all others */
+        free_chunks(chunk->prev);
+        chunk->prev = NULL;
+        arena->top = chunk_start(chunk);
+    }
+    arena->last = NULL;
+}
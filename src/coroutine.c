@@ -10,14 +10,29 @@
 
 /* stack_t (in ucontext.h) */
 #define _BSD_SOURCE
+#define _DEFAULT_SOURCE
 
-/* errno, ENOMEM */
+/* HAVE_* */
+#include "config.h"
+
+/* errno, ENOMEM, ENOENT, EBUSY */
 #include <errno.h>
-/* memset */
+/* memcpy, memmove, memset */
 #include <string.h>
+/* clock_gettime, CLOCK_MONOTONIC, struct timespec */
+#include <time.h>
+
+#ifdef __SANITIZE_ADDRESS__
+/* ASAN_UNPOISON_MEMORY_REGION */
+# include <sanitizer/asan_interface.h>
+#endif
 
+#if defined(HAVE_CONTEXT_X86_64) || defined(HAVE_CONTEXT_AARCH64)
+# define COROUTINE_FAST_CONTEXT
+#else
 /* ucontext_t, getcontext, makecontext, swapcontext */
-#include <ucontext.h>
+# include <ucontext.h>
+#endif
 
 /* allocator_t allocation_t, allocation_init, allocation_realloc_array */
 #include <threadless/allocation.h>
@@ -25,38 +40,313 @@
 #include <threadless/coroutine.h>
 
 
+#ifdef COROUTINE_FAST_CONTEXT
+
+/** Saved execution context
+ * Callee-saved registers and floating-point control state are pushed onto the
+ * suspended stack by coroutine_context_switch(); only the resulting stack
+ * pointer needs to be kept here. Unlike @c swapcontext(3), the signal mask is
+ * neither saved nor restored (so no system call is made).
+ */
+typedef struct {
+    void *sp;
+} context_t;
+
+/** Save the current context into @p from and activate @p to */
+void coroutine_context_switch(context_t *from, context_t *to)
+    __attribute__ ((visibility ("hidden")));
+/** Initial return address of a new context (calls entry point) */
+void coroutine_context_start(void)
+    __attribute__ ((visibility ("hidden")));
+
+#if defined(HAVE_CONTEXT_X86_64)
+/* System V AMD64 ABI: rbx, rbp, r12-r15, MXCSR, x87 control word */
+__asm__ (
+    ".text\n"
+    ".globl coroutine_context_switch\n"
+    ".hidden coroutine_context_switch\n"
+    ".type coroutine_context_switch, @function\n"
+    "coroutine_context_switch:\n"
+    "    pushq %rbp\n"
+    "    pushq %rbx\n"
+    "    pushq %r12\n"
+    "    pushq %r13\n"
+    "    pushq %r14\n"
+    "    pushq %r15\n"
+    "    subq $8, %rsp\n"
+    "    stmxcsr (%rsp)\n"
+    "    fnstcw 4(%rsp)\n"
+    "    movq %rsp, (%rdi)\n"
+    "    movq (%rsi), %rsp\n"
+    "    ldmxcsr (%rsp)\n"
+    "    fldcw 4(%rsp)\n"
+    "    addq $8, %rsp\n"
+    "    popq %r15\n"
+    "    popq %r14\n"
+    "    popq %r13\n"
+    "    popq %r12\n"
+    "    popq %rbx\n"
+    "    popq %rbp\n"
+    "    ret\n"
+    ".size coroutine_context_switch, .-coroutine_context_switch\n"
+    ".globl coroutine_context_start\n"
+    ".hidden coroutine_context_start\n"
+    ".type coroutine_context_start, @function\n"
+    "coroutine_context_start:\n"
+    "    movq %r12, %rdi\n"
+    "    callq *%r13\n"
+    "    ud2\n"
+    ".size coroutine_context_start, .-coroutine_context_start\n"
+);
+
+enum {
+    /* saved words: MXCSR/FPUCW, r15, r14, r13, r12, rbx, rbp, return */
+    CONTEXT_WORDS = 8,
+    CONTEXT_FP = 0,
+    CONTEXT_ARG = 4, /* r12 */
+    CONTEXT_ENTRY = 3, /* r13 */
+    CONTEXT_RETURN = 7,
+};
+
+/* default MXCSR (all exceptions masked) and x87 control word */
+#define CONTEXT_FP_CONTROL ((0x037FUL << 32) | 0x1F80UL)
+#elif defined(HAVE_CONTEXT_AARCH64)
+/* AAPCS64: x19-x30, d8-d15, FPCR */
+__asm__ (
+    ".text\n"
+    ".globl coroutine_context_switch\n"
+    ".hidden coroutine_context_switch\n"
+    ".type coroutine_context_switch, %function\n"
+    "coroutine_context_switch:\n"
+    "    sub sp, sp, #176\n"
+    "    stp x19, x20, [sp, #0]\n"
+    "    stp x21, x22, [sp, #16]\n"
+    "    stp x23, x24, [sp, #32]\n"
+    "    stp x25, x26, [sp, #48]\n"
+    "    stp x27, x28, [sp, #64]\n"
+    "    stp x29, x30, [sp, #80]\n"
+    "    stp d8, d9, [sp, #96]\n"
+    "    stp d10, d11, [sp, #112]\n"
+    "    stp d12, d13, [sp, #128]\n"
+    "    stp d14, d15, [sp, #144]\n"
+    "    mrs x9, fpcr\n"
+    "    str x9, [sp, #160]\n"
+    "    mov x9, sp\n"
+    "    str x9, [x0]\n"
+    "    ldr x9, [x1]\n"
+    "    mov sp, x9\n"
+    "    ldr x9, [sp, #160]\n"
+    "    msr fpcr, x9\n"
+    "    ldp x19, x20, [sp, #0]\n"
+    "    ldp x21, x22, [sp, #16]\n"
+    "    ldp x23, x24, [sp, #32]\n"
+    "    ldp x25, x26, [sp, #48]\n"
+    "    ldp x27, x28, [sp, #64]\n"
+    "    ldp x29, x30, [sp, #80]\n"
+    "    ldp d8, d9, [sp, #96]\n"
+    "    ldp d10, d11, [sp, #112]\n"
+    "    ldp d12, d13, [sp, #128]\n"
+    "    ldp d14, d15, [sp, #144]\n"
+    "    add sp, sp, #176\n"
+    "    ret\n"
+    ".size coroutine_context_switch, .-coroutine_context_switch\n"
+    ".globl coroutine_context_start\n"
+    ".hidden coroutine_context_start\n"
+    ".type coroutine_context_start, %function\n"
+    "coroutine_context_start:\n"
+    "    mov x0, x19\n"
+    "    blr x20\n"
+    "    brk #0\n"
+    ".size coroutine_context_start, .-coroutine_context_start\n"
+);
+
+enum {
+    /* saved words: x19-x30, d8-d15, FPCR, padding */
+    CONTEXT_WORDS = 22,
+    CONTEXT_FP = 20,
+    CONTEXT_ARG = 0, /* x19 */
+    CONTEXT_ENTRY = 1, /* x20 */
+    CONTEXT_RETURN = 11, /* x30 */
+};
+
+/* default FPCR (round to nearest, no traps) */
+#define CONTEXT_FP_CONTROL 0UL
+#endif
+
+#else /* !COROUTINE_FAST_CONTEXT */
+
+/** Saved execution context */
+typedef ucontext_t context_t;
+
+#endif /* COROUTINE_FAST_CONTEXT */
+
+
 enum {
     COROUTINE_ENDED = 1,
+    /** in scheduler ready queue */
+    COROUTINE_READY = 2,
+    /** context not yet built (shared stack only) */
+    COROUTINE_FRESH = 4,
+    /** stack painted (see coroutine_stack_high_water()) */
+    COROUTINE_PAINTED = 8,
 };
 
-typedef struct deferred deferred_t;
-struct deferred {
-    allocation_t allocation;
+enum {
+    /** stack (and header) alignment */
+    COROUTINE_ALIGN = 16,
+#ifndef COROUTINE_FAST_CONTEXT
+    /** stack bytes saved below the suspending frame (swapcontext(3) frame,
+     * red zone)
+     */
+    COROUTINE_STACK_MARGIN = 512,
+#endif
+    /** deferred records per chunk (the first chunk is part of the header) */
+    DEFERRED_CHUNK_SIZE = 6,
+    /** byte pattern of painted, untouched stack */
+    STACK_PAINT = 0xa5,
+};
+
+
+#ifdef __SANITIZE_ADDRESS__
+/* stack scan may read redzones of live (suspended) frames */
+# define NO_SANITIZE_ADDRESS __attribute__((no_sanitize_address))
+#else
+# define NO_SANITIZE_ADDRESS
+#endif
+
+typedef struct {
     coroutine_deferred_function_t *function;
     void *data;
-    deferred_t *next;
+} deferred_t;
+
+/** Resuming context (lives on the resumer's stack) */
+typedef struct {
+    /** resumer's saved context */
+    context_t   context;
+    /** value passed to coroutine_yield() */
+    void        *value;
+    /** coroutine running on behalf of resumer (see coroutine_transfer()) */
+    coroutine_t *current;
+} caller_t;
+
+typedef struct deferred_chunk deferred_chunk_t;
+struct deferred_chunk {
+    allocation_t allocation;
+    deferred_chunk_t *prev;
+    size_t count;
+    deferred_t records[DEFERRED_CHUNK_SIZE];
 };
 
 struct coroutine {
+    allocation_t         allocation;
+    context_t            context;
+    caller_t             *caller;
+    coroutine_function_t *function;
+    void                 *data;
+    int                  status;
+    deferred_chunk_t     *deferred;
+    deferred_chunk_t     deferred_inline;
+    size_t               stack_size;
+    coroutine_pool_t     *pool;
+    scheduler_t          *scheduler;
+    /* shared stack (or NULL if stack is part of allocation) */
+    coroutine_stack_t    *shared;
+    /* saved shared stack contents (while another coroutine uses it) */
+    allocation_t         saved;
+    size_t               saved_size;
+#ifndef COROUTINE_FAST_CONTEXT
+    /* lowest live shared stack address when last suspended */
+    char                 *stack_low;
+#endif
+    /* instrumentation counters (see coroutine_hooks_set()) */
+    uint64_t             switches;
+    uint64_t             run_time;
+    uint64_t             resumed_at;
+    /* idle pool list (while released) or ready queue (while ready) link */
+    coroutine_t          *next;
+};
+
+struct coroutine_pool {
     allocation_t allocation;
-    ucontext_t   context;
-    ucontext_t   caller;
-    void         *data;
-    int          status;
-    deferred_t   *deferred;
+    allocator_t  *allocator;
+    size_t       stack_size;
+    size_t       capacity;
+    size_t       count;
+    coroutine_t  *idle;
 };
 
+struct coroutine_stack {
+    allocation_t allocation;
+    size_t       size;
+    coroutine_t  *owner;
+};
 
-static void coroutine_entry_point(coroutine_t *, coroutine_function_t *)
+struct scheduler {
+    allocation_t allocation;
+    coroutine_t  *head;
+    coroutine_t  **tail;
+    size_t       ready;
+    size_t       count;
+};
+
+
+/* installed hooks (or NULL if instrumentation is disabled) */
+static const coroutine_hooks_t *hooks;
+static coroutine_hooks_t hooks_storage;
+
+
+/* monotonic time (nanoseconds) */
+static uint64_t clock_now(void)
+{
+    struct timespec now;
+    (void) clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000u + (uint64_t) now.tv_nsec;
+}
+
+
+static void trace_resume(coroutine_t *coro)
+{
+    coro->switches++;
+    if (NULL != hooks->resume) {
+        hooks->resume(coro, hooks->data);
+    }
+    /* exclude hook from run time */
+    coro->resumed_at = clock_now();
+}
+
+
+static void trace_yield(coroutine_t *coro)
+{
+    if (0 != coro->resumed_at) {
+        coro->run_time += clock_now() - coro->resumed_at;
+        coro->resumed_at = 0;
+    }
+    if (NULL != hooks->yield) {
+        hooks->yield(coro, hooks->data);
+    }
+}
+
+
+static void trace_event(coroutine_t *coro, coroutine_hook_function_t *hook)
+{
+    if (NULL != hook) {
+        hook(coro, hooks->data);
+    }
+}
+
+
+static void coroutine_entry_point(coroutine_t *)
     __attribute__ ((noreturn));
-static void coroutine_entry_point(coroutine_t *c,
-    coroutine_function_t *function)
+static void coroutine_entry_point(coroutine_t *c)
 {
     /* run function until it returns */
-    void *retval = function(c, c->data);
+    void *retval = c->function(c, c->data);
 
     /* mark as ended */
     c->status |= COROUTINE_ENDED;
+    if (NULL != hooks) {
+        trace_event(c, hooks->end);
+    }
 
     /* yield final return value (forever) */
     for (;;) {
@@ -65,117 +355,775 @@ static void coroutine_entry_point(coroutine_t *c,
 }
 
 
-coroutine_t *coroutine_create(allocator_t *allocator,
-    coroutine_function_t *function, size_t stack_size)
+static void context_init(context_t *context, void *stack, size_t stack_size,
+    coroutine_t *coro)
+{
+#ifdef COROUTINE_FAST_CONTEXT
+    /* build initial frame at (aligned) top of stack */
+    void **sp = (void **)(((size_t) stack + stack_size) & ~(size_t) 15);
+    sp -= CONTEXT_WORDS;
+    memset(sp, 0, CONTEXT_WORDS * sizeof(*sp));
+    sp[CONTEXT_FP] = (void *) CONTEXT_FP_CONTROL;
+    sp[CONTEXT_ARG] = coro;
+    sp[CONTEXT_ENTRY] = (void *)(size_t) coroutine_entry_point;
+    sp[CONTEXT_RETURN] = (void *)(size_t) coroutine_context_start;
+    context->sp = sp;
+#else
+    (void) getcontext(context);
+    context->uc_stack.ss_sp = stack;
+    context->uc_stack.ss_size = stack_size;
+    makecontext(context, (void (*)(void)) coroutine_entry_point, 1, coro);
+#endif
+}
+
+
+static inline void context_switch(context_t *from, context_t *to)
+{
+#ifdef COROUTINE_FAST_CONTEXT
+    coroutine_context_switch(from, to);
+#else
+    (void) swapcontext(from, to);
+#endif
+}
+
+
+static coroutine_t *coroutine_alloc(allocator_t *allocator,
+    size_t stack_size)
 {
     coroutine_t *coro = NULL;
-    size_t alloc_size = sizeof(*coro) + stack_size;
+    size_t stack_bytes = (stack_size + COROUTINE_ALIGN - 1) &
+        ~(size_t)(COROUTINE_ALIGN - 1);
+    size_t alloc_size = stack_bytes + sizeof(*coro);
 
-    if (alloc_size < stack_size) {
+    if (stack_bytes < stack_size || alloc_size < stack_bytes) {
         /* integer overflow */
         errno = ENOMEM;
-        goto fail;
+        return NULL;
     }
 
     allocation_t allocation;
     allocation_init(&allocation, allocator);
     if (allocation_realloc_array(&allocation, 1, alloc_size)) {
-        goto fail;
+        return NULL;
     }
 
-    coro = allocation.memory;
-    memset(coro, 0, alloc_size);
+    /* stack occupies the bottom of the allocation, header the top, so that
+     * a stack overflow runs off the start of the allocation (into a guard
+     * page, if provided by the allocator) instead of into the header
+     */
+    coro = (coroutine_t *)((char *) allocation.memory + stack_bytes);
+
+    /* initialize header only (stack is left as-is) */
+    memset(coro, 0, sizeof(*coro));
     coro->allocation = allocation;
+    coro->stack_size = stack_bytes;
+
+    return coro;
+}
+
+
+/* paint one in paint_period coroutine stacks (0: none) */
+static unsigned paint_period;
+/* coroutines armed since last painted one */
+static unsigned paint_count;
+/* high-water marks of painted stacks, by power of two */
+static size_t stack_histogram[COROUTINE_STACK_HISTOGRAM_SIZE];
+
+
+static void stack_unpoison(void *stack, size_t size)
+{
+#ifdef __SANITIZE_ADDRESS__
+    /* frames that were never unwound (of a suspended coroutine, or of
+     * another coroutine on a shared stack) leave stale redzones behind
+     */
+    ASAN_UNPOISON_MEMORY_REGION(stack, size);
+#else
+    (void) stack;
+    (void) size;
+#endif
+}
+
+
+static void stack_paint(coroutine_t *coro)
+{
+    stack_unpoison(coro->allocation.memory, coro->stack_size);
+    memset(coro->allocation.memory, STACK_PAINT, coro->stack_size);
+    coro->status |= COROUTINE_PAINTED;
+}
+
+
+static inline bool paint_sampled(void)
+{
+    if (0 == paint_period) {
+        return false;
+    }
+    if (++paint_count < paint_period) {
+        return false;
+    }
+    paint_count = 0;
+    return true;
+}
+
+
+static void coroutine_arm(coroutine_t *coro, coroutine_function_t *function)
+{
+    coro->function = function;
+    coro->data = NULL;
     coro->status = 0;
-    coro->deferred = NULL;
-    (void) getcontext(&coro->context);
-    coro->context.uc_stack.ss_sp = coro + 1;
-    coro->context.uc_stack.ss_size = stack_size;
+    coro->scheduler = NULL;
+    coro->deferred_inline.prev = NULL;
+    coro->deferred_inline.count = 0;
+    coro->deferred = &coro->deferred_inline;
+    coro->switches = 0;
+    coro->run_time = 0;
+    coro->resumed_at = 0;
+    if (NULL != coro->shared) {
+        /* built once the shared stack is acquired (see stack_acquire()) */
+        coro->status = COROUTINE_FRESH;
+    } else {
+        if (paint_sampled()) {
+            stack_paint(coro);
+        }
+        context_init(&coro->context, coro->allocation.memory,
+            coro->stack_size, coro);
+    }
+    if (NULL != hooks) {
+        trace_event(coro, hooks->create);
+    }
+}
+
+
+static void coroutine_free(coroutine_t *coro)
+{
+    allocation_t allocation = coro->allocation;
+    stack_unpoison(allocation.memory, coro->stack_size);
+    if (NULL != coro->shared) {
+        if (coro->shared->owner == coro) {
+            coro->shared->owner = NULL;
+        }
+        allocation_free(&(coro->saved));
+    }
+    allocation_free(&allocation);
+}
+
+
+coroutine_t *coroutine_create(allocator_t *allocator,
+    coroutine_function_t *function, size_t stack_size)
+{
+    coroutine_t *coro = coroutine_alloc(allocator, stack_size);
 
-    makecontext(&coro->context, (void (*)(void)) coroutine_entry_point, 2,
-        coro, function);
+    if (NULL != coro) {
+        coroutine_arm(coro, function);
+    }
 
     return coro;
+}
 
-fail:
-    coroutine_destroy(coro);
 
-    return NULL;
+coroutine_stack_t *coroutine_stack_create(allocator_t *allocator,
+    size_t size)
+{
+    coroutine_stack_t *stack;
+    size_t stack_bytes = (size + COROUTINE_ALIGN - 1) &
+        ~(size_t)(COROUTINE_ALIGN - 1);
+    size_t alloc_size = stack_bytes + sizeof(*stack);
+    allocation_t allocation;
+
+    if (stack_bytes < size || alloc_size < stack_bytes) {
+        /* integer overflow */
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    allocation_init(&allocation, allocator);
+    if (allocation_realloc_array(&allocation, 1, alloc_size)) {
+        return NULL;
+    }
+
+    /* stack at the bottom of the allocation (as in coroutine_alloc()) */
+    stack = (coroutine_stack_t *)((char *) allocation.memory + stack_bytes);
+    stack->allocation = allocation;
+    stack->size = stack_bytes;
+    stack->owner = NULL;
+
+    return stack;
 }
 
 
-static void coroutine_run_deferred(coroutine_t *coro)
+void coroutine_stack_destroy(coroutine_stack_t *stack)
 {
-    deferred_t *deferred = coro->deferred;
-    while (NULL != deferred) {
-        allocation_t allocation = deferred->allocation;
-        deferred->function(deferred->data);
-        deferred = deferred->next;
+    if (NULL != stack) {
+        allocation_t allocation = stack->allocation;
+        stack_unpoison(allocation.memory, stack->size);
         allocation_free(&allocation);
     }
 }
 
 
+coroutine_t *coroutine_create_shared(allocator_t *allocator,
+    coroutine_function_t *function, coroutine_stack_t *stack)
+{
+    /* header only */
+    coroutine_t *coro = coroutine_alloc(allocator, 0);
+
+    if (NULL != coro) {
+        coro->shared = stack;
+        allocation_init(&(coro->saved), allocator);
+        coroutine_arm(coro, function);
+    }
+
+    return coro;
+}
+
+
+static int stack_save(coroutine_t *coro)
+{
+    coroutine_stack_t *stack = coro->shared;
+    char *base = stack->allocation.memory;
+    char *top = base + stack->size;
+#ifdef COROUTINE_FAST_CONTEXT
+    char *low = coro->context.sp;
+#else
+    char *low = coro->stack_low;
+#endif
+    size_t size;
+
+    if (low < base || low > top) {
+        /* e.g., marker variable not on stack (sanitizer fake stack) */
+        low = base;
+    }
+    size = (size_t)(top - low);
+
+    /* grow only, so that steady-state switches do not allocate */
+    if (coro->saved.size < size &&
+        allocation_realloc_array(&(coro->saved), 1, size)) {
+        return -1;
+    }
+    stack_unpoison(base, stack->size);
+    memcpy(coro->saved.memory, low, size);
+    coro->saved_size = size;
+
+    return 0;
+}
+
+
+static int stack_acquire(coroutine_t *coro)
+{
+    coroutine_stack_t *stack = coro->shared;
+    coroutine_t *owner = stack->owner;
+
+    if (owner == coro) {
+        /* stack still holds this coroutine's frames */
+        return 0;
+    }
+
+    if (NULL != owner) {
+        if (NULL != owner->caller) {
+            /* owner is running (e.g., is resuming this coroutine) */
+            errno = EBUSY;
+            return -1;
+        }
+        /* save owner's live frames lazily, only once stack is needed */
+        if (stack_save(owner)) {
+            return -1;
+        }
+        stack->owner = NULL;
+    }
+
+    if (coro->status & COROUTINE_FRESH) {
+        context_init(&coro->context, stack->allocation.memory, stack->size,
+            coro);
+        coro->status &= ~COROUTINE_FRESH;
+    } else {
+        char *top = (char *) stack->allocation.memory + stack->size;
+        stack_unpoison(stack->allocation.memory, stack->size);
+        memcpy(top - coro->saved_size, coro->saved.memory, coro->saved_size);
+    }
+    stack->owner = coro;
+
+    return 0;
+}
+
+
+#ifdef COROUTINE_FAST_CONTEXT
+/* suspended stack pointer is saved by context switch */
+# define stack_mark(coro, local) ((void) 0)
+#else
+static inline void stack_mark(coroutine_t *coro, void *local)
+{
+    coro->stack_low = (char *) local - COROUTINE_STACK_MARGIN;
+}
+#endif
+
+
+static void deferred_chunk_unlink(coroutine_t *coro, deferred_chunk_t *above,
+    deferred_chunk_t *chunk)
+{
+    if (NULL != above) {
+        above->prev = chunk->prev;
+    } else {
+        coro->deferred = chunk->prev;
+    }
+    allocation_t allocation = chunk->allocation;
+    allocation_free(&allocation);
+}
+
+
+static void coroutine_run_deferred(coroutine_t *coro)
+{
+    deferred_chunk_t *chunk;
+    /* pop one record at a time (functions may defer or cancel others) */
+    while ((chunk = coro->deferred)->count || chunk != &coro->deferred_inline) {
+        if (chunk->count) {
+            deferred_t deferred = chunk->records[--chunk->count];
+            deferred.function(deferred.data);
+        } else {
+            /* release empty overflow chunk */
+            deferred_chunk_unlink(coro, NULL, chunk);
+        }
+    }
+}
+
+
+static void stack_record(const coroutine_t *coro)
+{
+    size_t high_water;
+    size_t bucket = 0;
+
+    if (0 == (coro->status & COROUTINE_PAINTED)) {
+        return;
+    }
+    high_water = coroutine_stack_high_water(coro);
+    while (high_water > 1 && bucket < COROUTINE_STACK_HISTOGRAM_SIZE - 1) {
+        high_water >>= 1;
+        ++bucket;
+    }
+    stack_histogram[bucket]++;
+}
+
+
+void coroutine_stack_paint(coroutine_t *coro)
+{
+    if (NULL == coro->shared) {
+        stack_paint(coro);
+        /* rebuild initial frame over paint */
+        context_init(&coro->context, coro->allocation.memory,
+            coro->stack_size, coro);
+    }
+}
+
+
+void coroutine_stack_paint_sample(unsigned period)
+{
+    paint_period = period;
+    paint_count = 0;
+}
+
+
+NO_SANITIZE_ADDRESS
+size_t coroutine_stack_high_water(const coroutine_t *coro)
+{
+    const unsigned char *stack = coro->allocation.memory;
+    size_t untouched = 0;
+
+    if (0 == (coro->status & COROUTINE_PAINTED)) {
+        return 0;
+    }
+    /* stack grows down: untouched paint remains at the bottom */
+    while (untouched < coro->stack_size && STACK_PAINT == stack[untouched]) {
+        ++untouched;
+    }
+
+    return coro->stack_size - untouched;
+}
+
+
+void coroutine_stack_histogram(
+    size_t histogram[COROUTINE_STACK_HISTOGRAM_SIZE])
+{
+    memcpy(histogram, stack_histogram, sizeof(stack_histogram));
+}
+
+
+void coroutine_stack_histogram_reset(void)
+{
+    memset(stack_histogram, 0, sizeof(stack_histogram));
+}
+
+
+void coroutine_hooks_set(const coroutine_hooks_t *new_hooks)
+{
+    if (NULL != new_hooks) {
+        hooks_storage = *new_hooks;
+        hooks = &hooks_storage;
+    } else {
+        hooks = NULL;
+    }
+}
+
+
+uint64_t coroutine_switches(const coroutine_t *coro)
+{
+    return coro->switches;
+}
+
+
+uint64_t coroutine_run_time(const coroutine_t *coro)
+{
+    return coro->run_time;
+}
+
+
 void coroutine_destroy(coroutine_t *coro)
 {
     if (NULL != coro) {
-        coroutine_run_deferred(coro);
-        allocation_t allocation = coro->allocation;
+        if (NULL != coro->pool) {
+            coroutine_pool_release(coro);
+        } else {
+            coroutine_run_deferred(coro);
+            stack_record(coro);
+            if (NULL != hooks) {
+                trace_event(coro, hooks->destroy);
+            }
+            coroutine_free(coro);
+        }
+    }
+}
+
+
+coroutine_pool_t *coroutine_pool_create(allocator_t *allocator,
+    size_t stack_size, size_t capacity)
+{
+    coroutine_pool_t *pool;
+    allocation_t allocation;
+
+    allocation_init(&allocation, allocator);
+    if (allocation_realloc_array(&allocation, 1, sizeof(*pool))) {
+        return NULL;
+    }
+
+    pool = allocation.memory;
+    pool->allocation = allocation;
+    pool->allocator = allocator;
+    pool->stack_size = stack_size;
+    pool->capacity = capacity;
+    pool->count = 0;
+    pool->idle = NULL;
+
+    return pool;
+}
+
+
+void coroutine_pool_destroy(coroutine_pool_t *pool)
+{
+    if (NULL != pool) {
+        /* release all idle coroutines */
+        coroutine_pool_trim(pool, 0);
+        allocation_t allocation = pool->allocation;
         allocation_free(&allocation);
     }
 }
 
 
+void coroutine_pool_trim(coroutine_pool_t *pool, size_t count)
+{
+    while (pool->count > count) {
+        coroutine_t *coro = pool->idle;
+        pool->idle = coro->next;
+        pool->count--;
+        coroutine_free(coro);
+    }
+}
+
+
+coroutine_t *coroutine_pool_acquire(coroutine_pool_t *pool,
+    coroutine_function_t *function)
+{
+    coroutine_t *coro = pool->idle;
+
+    if (NULL != coro) {
+        /* reuse most recently released (cache-hot) coroutine */
+        pool->idle = coro->next;
+        pool->count--;
+    } else {
+        coro = coroutine_alloc(pool->allocator, pool->stack_size);
+        if (NULL == coro) {
+            return NULL;
+        }
+    }
+
+    coro->pool = pool;
+    coro->next = NULL;
+    coroutine_arm(coro, function);
+
+    return coro;
+}
+
+
+void coroutine_pool_release(coroutine_t *coro)
+{
+    if (NULL != coro) {
+        coroutine_pool_t *pool = coro->pool;
+
+        coroutine_run_deferred(coro);
+        stack_record(coro);
+        if (NULL != hooks) {
+            trace_event(coro, hooks->destroy);
+        }
+
+        if (pool->count < pool->capacity) {
+            /* keep coroutine (and stack) for reuse */
+            coro->next = pool->idle;
+            pool->idle = coro;
+            pool->count++;
+        } else {
+            coroutine_free(coro);
+        }
+    }
+}
+
+
 bool coroutine_ended(const coroutine_t *coro)
 {
     return (NULL == coro) || !!(coro->status & COROUTINE_ENDED);
 }
 
 
+bool coroutine_stack_shared(const coroutine_t *coro)
+{
+    return NULL != coro->shared;
+}
+
+
+static void *coroutine_enter(coroutine_t *coro, void *value,
+    coroutine_t **current)
+{
+    caller_t caller;
+
+    if (NULL != coro->shared && stack_acquire(coro)) {
+        return NULL;
+    }
+
+    caller.value = NULL;
+    caller.current = coro;
+    coro->caller = &caller;
+    coro->data = value;
+    if (NULL != hooks) {
+        trace_resume(coro);
+    }
+    context_switch(&caller.context, &coro->context);
+
+    /* the coroutine that yielded may differ, after coroutine_transfer() */
+    if (NULL != current) {
+        *current = caller.current;
+    }
+    return caller.value;
+}
+
+
 void *coroutine_resume(coroutine_t *coro, void *value)
 {
     if (NULL == coro) {
         return NULL;
     }
-    coro->data = value;
-    (void) swapcontext(&coro->caller, &coro->context);
-    return coro->data;
+    return coroutine_enter(coro, value, NULL);
 }
 
 
 void *coroutine_yield(coroutine_t *coro, void *value)
 {
+    caller_t *caller;
+
     if (NULL == coro) {
         return NULL;
     }
-    coro->data = value;
-    (void) swapcontext(&coro->context, &coro->caller);
+    if (NULL != hooks) {
+        trace_yield(coro);
+    }
+    caller = coro->caller;
+    caller->value = value;
+    coro->caller = NULL;
+    stack_mark(coro, &caller);
+    context_switch(&coro->context, &caller->context);
     return coro->data;
 }
 
 
+void *coroutine_transfer(coroutine_t *from, coroutine_t *to, void *value)
+{
+    caller_t *caller = from->caller;
+
+    if (NULL != to->shared && stack_acquire(to)) {
+        return NULL;
+    }
+
+    if (NULL != hooks) {
+        trace_yield(from);
+        trace_resume(to);
+    }
+
+    /* hand resumer over to to, so that it yields in from's place */
+    caller->current = to;
+    to->caller = caller;
+    to->data = value;
+    from->caller = NULL;
+    stack_mark(from, &caller);
+    context_switch(&from->context, &to->context);
+    return from->data;
+}
+
+
 int coroutine_defer(coroutine_t *coro, coroutine_deferred_function_t *function,
     void *data)
 {
-    int error;
-    deferred_t *deferred = NULL;
+    deferred_chunk_t *chunk = coro->deferred;
+
+    if (DEFERRED_CHUNK_SIZE == chunk->count) {
+        /* current chunk is full: allocate overflow chunk */
+        allocation_t allocation;
+        allocation_init(&allocation, coro->allocation.allocator);
+        if (allocation_realloc_array(&allocation, 1, sizeof(*chunk))) {
+            return -1;
+        }
+        chunk = allocation.memory;
+        chunk->allocation = allocation;
+        chunk->prev = coro->deferred;
+        chunk->count = 0;
+        coro->deferred = chunk;
+    }
+
+    /* push deferred work to top of stack */
+    chunk->records[chunk->count].function = function;
+    chunk->records[chunk->count].data = data;
+    chunk->count++;
+
+    return 0;
+}
+
+
+int coroutine_defer_cancel(coroutine_t *coro,
+    coroutine_deferred_function_t *function, void *data)
+{
+    deferred_chunk_t *above = NULL;
+    deferred_chunk_t *chunk;
+
+    /* search from most to least recently registered */
+    for (chunk = coro->deferred; NULL != chunk; chunk = chunk->prev) {
+        size_t i = chunk->count;
+        while (i--) {
+            deferred_t *record = &(chunk->records[i]);
+            if (record->function == function && record->data == data) {
+                /* close gap, preserving order */
+                memmove(record, record + 1,
+                    (chunk->count - i - 1) * sizeof(*record));
+                chunk->count--;
+                if (!chunk->count && chunk != &coro->deferred_inline) {
+                    deferred_chunk_unlink(coro, above, chunk);
+                }
+                return 0;
+            }
+        }
+        above = chunk;
+    }
+
+    /* not found */
+    errno = ENOENT;
+    return -1;
+}
+
+
+scheduler_t *scheduler_create(allocator_t *allocator)
+{
+    scheduler_t *scheduler;
     allocation_t allocation;
 
-    /* allocate memory */
-    allocation_init(&allocation, coro->allocation.allocator);
-    error = allocation_realloc_array(&allocation, 1, sizeof(*deferred));
+    allocation_init(&allocation, allocator);
+    if (allocation_realloc_array(&allocation, 1, sizeof(*scheduler))) {
+        return NULL;
+    }
+
+    scheduler = allocation.memory;
+    scheduler->allocation = allocation;
+    scheduler->head = NULL;
+    scheduler->tail = &scheduler->head;
+    scheduler->ready = 0;
+    scheduler->count = 0;
+
+    return scheduler;
+}
+
+
+void scheduler_destroy(scheduler_t *scheduler)
+{
+    if (NULL != scheduler) {
+        allocation_t allocation = scheduler->allocation;
+        allocation_free(&allocation);
+    }
+}
+
+
+void coroutine_spawn(scheduler_t *scheduler, coroutine_t *coro, void *data)
+{
+    coro->scheduler = scheduler;
+    scheduler->count++;
+    coroutine_ready(coro, data);
+}
 
-    if (!error) {
-       /* initialize deferred work */
-        deferred = allocation.memory;
-        deferred->allocation = allocation;
-        deferred->function = function;
-        deferred->data = data;
 
-        /* push deferred work to front of list */
-        deferred->next = coro->deferred;
-        coro->deferred = deferred;
+void coroutine_ready(coroutine_t *coro, void *value)
+{
+    scheduler_t *scheduler = coro->scheduler;
+
+    if (!(coro->status & COROUTINE_READY)) {
+        /* append to ready queue */
+        coro->status |= COROUTINE_READY;
+        coro->data = value;
+        coro->next = NULL;
+        *scheduler->tail = coro;
+        scheduler->tail = &coro->next;
+        scheduler->ready++;
     }
+}
+
+
+size_t scheduler_run(scheduler_t *scheduler, size_t max)
+{
+    size_t count;
+    coroutine_t *coro;
+
+    for (count = 0; (!max || count < max) &&
+        NULL != (coro = scheduler->head); ++count) {
+        /* pop front of ready queue */
+        scheduler->head = coro->next;
+        if (NULL == scheduler->head) {
+            scheduler->tail = &scheduler->head;
+        }
+        scheduler->ready--;
+        coro->status &= ~COROUTINE_READY;
+
+        (void) coroutine_enter(coro, coro->data, &coro);
 
-    return error;
+        /* an ended coroutine that made itself ready is destroyed once it
+         * leaves the ready queue (resuming it again just yields)
+         */
+        if (coroutine_ended(coro) && !(coro->status & COROUTINE_READY) &&
+            coro->scheduler == scheduler) {
+            scheduler->count--;
+            coroutine_destroy(coro);
+        }
+    }
+
+    return count;
+}
+
+
+size_t scheduler_ready_count(const scheduler_t *scheduler)
+{
+    return scheduler->ready;
+}
+
+
+size_t scheduler_count(const scheduler_t *scheduler)
+{
+    return scheduler->count;
 }
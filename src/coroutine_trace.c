@@ -0,0 +1,145 @@
+/* threadless.io
+ * Copyright (c) 2016 Justin R. Cutler
+ * Licensed under the MIT License. See LICENSE file in the project root for
+ * full license information.
+ */
+/** @file
+ * coroutine trace exporter implementation
+ * @author Justin R. Cutler <justin.r.cutler@gmail.com>
+ *
+ * Writes the Chrome trace event JSON array format: one event object per hook
+ * call, so that the trace is written incrementally (and buffered by stdio).
+ */
+
+/* errno, EIO */
+#include <errno.h>
+/* bool, true, false */
+#include <stdbool.h>
+/* uint64_t, uintptr_t */
+#include <stdint.h>
+/* FILE, fprintf, fputs, fflush, ferror */
+#include <stdio.h>
+
+/* allocation_init, allocation_realloc_array, allocation_free */
+#include <threadless/allocation.h>
+/* coroutine_t, coroutine_hooks_t, coroutine_hooks_set */
+#include <threadless/coroutine.h>
+/* timer_now */
+#include <threadless/timer_queue.h>
+/* ... */
+#include <threadless/coroutine_trace.h>
+
+
+struct coroutine_trace {
+    allocation_t allocation;
+    FILE         *file;
+    /* time of trace start (see timer_now()) */
+    uint64_t     start;
+    /* no event written yet */
+    bool         first;
+};
+
+
+static void trace_write(coroutine_trace_t *trace, const coroutine_t *coro,
+    const char *name, const char *phase)
+{
+    uint64_t ns = timer_now() - trace->start;
+
+    fprintf(trace->file, "%s\n{\"name\":\"%s\",\"ph\":\"%s\",\"pid\":1,"
+        "\"tid\":%llu,\"ts\":%llu.%03u%s}", trace->first ? "" : ",", name,
+        phase, (unsigned long long)(uintptr_t) coro,
+        (unsigned long long)(ns / 1000), (unsigned)(ns % 1000),
+        ('i' == phase[0]) ? ",\"s\":\"t\"" : "");
+    trace->first = false;
+}
+
+
+static void trace_create(coroutine_t *coro, void *data)
+{
+    coroutine_trace_t *trace = data;
+
+    /* name coroutine's track (metadata events have no timestamp) */
+    fprintf(trace->file, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\","
+        "\"pid\":1,\"tid\":%llu,\"args\":{\"name\":\"coroutine %p\"}}",
+        trace->first ? "" : ",", (unsigned long long)(uintptr_t) coro,
+        (void *) coro);
+    trace->first = false;
+    trace_write(trace, coro, "create", "i");
+}
+
+
+static void trace_resume(coroutine_t *coro, void *data)
+{
+    trace_write(data, coro, "run", "B");
+}
+
+
+static void trace_yield(coroutine_t *coro, void *data)
+{
+    trace_write(data, coro, "run", "E");
+}
+
+
+static void trace_end(coroutine_t *coro, void *data)
+{
+    trace_write(data, coro, "end", "i");
+}
+
+
+static void trace_destroy(coroutine_t *coro, void *data)
+{
+    trace_write(data, coro, "destroy", "i");
+}
+
+
+coroutine_trace_t *coroutine_trace_start(allocator_t *allocator, FILE *file)
+{
+    coroutine_hooks_t hooks = {
+        .create = trace_create,
+        .resume = trace_resume,
+        .yield = trace_yield,
+        .end = trace_end,
+        .destroy = trace_destroy,
+    };
+    coroutine_trace_t *trace;
+    allocation_t allocation;
+
+    allocation_init(&allocation, allocator);
+    if (allocation_realloc_array(&allocation, 1, sizeof(*trace))) {
+        return NULL;
+    }
+
+    trace = allocation.memory;
+    trace->allocation = allocation;
+    trace->file = file;
+    trace->start = timer_now();
+    trace->first = true;
+
+    fputs("[", file);
+    hooks.data = trace;
+    coroutine_hooks_set(&hooks);
+
+    return trace;
+}
+
+
+int coroutine_trace_stop(coroutine_trace_t *trace)
+{
+    allocation_t allocation = trace->allocation;
+    FILE *file = trace->file;
+
+    coroutine_hooks_set(NULL);
+    allocation_free(&allocation);
+
+    fputs("\n]\n", file);
+    if (fflush(file)) {
+        return -1;
+    }
+    if (ferror(file)) {
+        /* an earlier (buffered) write failed */
+        errno = EIO;
+        return -1;
+    }
+
+    return 0;
+}
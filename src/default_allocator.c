@@ -8,8 +8,19 @@
  * @author Justin R. Cutler <justin.r.cutler@gmail.com>
  */
 
-/* realloc */
+#define _POSIX_C_SOURCE 200112L
+
+/* HAVE_* */
+#include "config.h"
+
+/* errno */
+#include <errno.h>
+/* uintptr_t */
+#include <stdint.h>
+/* realloc, free, posix_memalign */
 #include <stdlib.h>
+/* memcpy */
+#include <string.h>
 
 /* ... */
 #include <threadless/default_allocator.h>
@@ -20,7 +31,13 @@ static int default_allocate(allocation_t *allocation, size_t size)
     void *new_memory;
 
     /* perform allocator action */
-    new_memory = realloc(allocation->memory, size);
+    if (0 == size) {
+        /* realloc(p, 0) need not free p (and may allocate) */
+        free(allocation->memory);
+        new_memory = NULL;
+    } else {
+        new_memory = realloc(allocation->memory, size);
+    }
 
     if ((NULL == new_memory) && (size != 0)) {
         /* realloc failed */
@@ -35,6 +52,46 @@ static int default_allocate(allocation_t *allocation, size_t size)
 }
 
 
+#ifdef HAVE_POSIX_MEMALIGN
+static int default_allocate_aligned(allocation_t *allocation, size_t size,
+    size_t alignment)
+{
+    void *new_memory;
+    int error;
+
+    if (NULL != allocation->memory && size <= allocation->size &&
+        0 == ((uintptr_t) allocation->memory & (alignment - 1))) {
+        /* shrink in place (realloc() might not preserve alignment) */
+        allocation->size = size;
+        return 0;
+    }
+
+    /* posix_memalign() requires a multiple of sizeof(void *) */
+    if (alignment < sizeof(void *)) {
+        alignment = sizeof(void *);
+    }
+
+    error = posix_memalign(&new_memory, alignment, size);
+    if (error) {
+        errno = error;
+        return -1;
+    }
+
+    if (NULL != allocation->memory) {
+        memcpy(new_memory, allocation->memory,
+            (allocation->size < size) ? allocation->size : size);
+        free(allocation->memory);
+    }
+
+    /* update allocation */
+    allocation->memory = new_memory;
+    allocation->size = size;
+
+    return 0;
+}
+#endif
+
+
 static void default_destroy(allocator_t *allocator)
 {
     /* ignore allocator */
@@ -45,6 +102,9 @@ static void default_destroy(allocator_t *allocator)
 static allocator_t default_allocator = {
     .allocate = default_allocate,
     .destroy = default_destroy,
+#ifdef HAVE_POSIX_MEMALIGN
+    .aligned = default_allocate_aligned,
+#endif
 };
 
 
@@ -0,0 +1,210 @@
+/* threadless.io
+ * Copyright (c) 2016 Justin R. Cutler
+ * Licensed under the MIT License. See LICENSE file in the project root for
+ * full license information.
+ */
+/** @file
+ * d-ary keyed heap interface implementation
+ * @author Justin R. Cutler <justin.r.cutler@gmail.com>
+ */
+
+/* size_t, NULL */
+#include <stddef.h>
+/* uint64_t */
+#include <stdint.h>
+
+/* allocation_realloc_array */
+#include <threadless/allocation.h>
+/* ... */
+#include <threadless/dheap.h>
+
+
+enum {
+    /** minimum non-zero storage capacity (in nodes) */
+    DHEAP_MIN_CAPACITY = 16,
+};
+
+
+static int dheap_resize(dheap_t *heap, size_t capacity)
+{
+    int error = allocation_realloc_array(&(heap->allocation), capacity,
+        sizeof(dheap_entry_t));
+    if (!error) {
+        heap->capacity = capacity;
+    }
+    return error;
+}
+
+
+static void dheap_shrink(dheap_t *heap)
+{
+    size_t capacity = heap->capacity;
+
+    /* halve capacity while less than 1/4 full */
+    while (capacity > DHEAP_MIN_CAPACITY && heap->count < (capacity >> 2)) {
+        capacity >>= 1;
+    }
+
+    if (capacity != heap->capacity) {
+        /* shrinking failure is harmless */
+        (void) dheap_resize(heap, capacity);
+    }
+}
+
+
+static inline void place(dheap_entry_t *storage, size_t pos,
+    dheap_entry_t entry)
+{
+    storage[pos] = entry;
+    entry.node->index = pos;
+}
+
+
+static void sift_down(const dheap_t *heap, size_t pos, dheap_entry_t entry)
+{
+    dheap_entry_t *storage = heap->allocation.memory;
+    /* move "worse" parents down into the hole until entry fits */
+    while (pos > 0) {
+        size_t parent = (pos - 1) / DHEAP_ARITY;
+        if (storage[parent].key <= entry.key) {
+            break;
+        }
+        place(storage, pos, storage[parent]);
+        pos = parent;
+    }
+    place(storage, pos, entry);
+}
+
+
+static void sift_up(const dheap_t *heap, size_t pos, dheap_entry_t entry)
+{
+    dheap_entry_t *storage = heap->allocation.memory;
+    size_t end = heap->count;
+    /* move "best" child up into the hole until entry fits */
+    for (;;) {
+        size_t child = pos * DHEAP_ARITY + 1;
+        size_t last = child + DHEAP_ARITY;
+        size_t best = child;
+        if (child >= end) {
+            break;
+        }
+        if (last > end) {
+            last = end;
+        }
+        for (++child; child < last; ++child) {
+            if (storage[child].key < storage[best].key) {
+                best = child;
+            }
+        }
+        if (entry.key <= storage[best].key) {
+            break;
+        }
+        place(storage, pos, storage[best]);
+        pos = best;
+    }
+    place(storage, pos, entry);
+}
+
+
+static void sift(const dheap_t *heap, size_t pos, dheap_entry_t entry)
+{
+    dheap_entry_t *storage = heap->allocation.memory;
+    if (pos > 0 && entry.key < storage[(pos - 1) / DHEAP_ARITY].key) {
+        sift_down(heap, pos, entry);
+    } else {
+        sift_up(heap, pos, entry);
+    }
+}
+
+
+int dheap_reserve(dheap_t *heap, size_t count)
+{
+    size_t capacity = heap->capacity ? heap->capacity : DHEAP_MIN_CAPACITY;
+
+    if (count <= heap->capacity) {
+        return 0;
+    }
+
+    /* grow geometrically (amortized O(1) per push) */
+    while (capacity < count && capacity <= (((size_t) -1) >> 1)) {
+        capacity <<= 1;
+    }
+    if (capacity < count) {
+        capacity = count;
+    }
+
+    return dheap_resize(heap, capacity);
+}
+
+
+int dheap_push(dheap_t *heap, dheap_node_t *node, uint64_t key)
+{
+    int error = 0;
+    if (heap->count == heap->capacity) {
+        error = dheap_reserve(heap, heap->count + 1);
+    }
+    if (!error) {
+        dheap_entry_t entry = { key, node };
+        /* bubble new entry into place from end of heap */
+        node->heap = heap;
+        sift_down(heap, heap->count++, entry);
+    }
+    return error;
+}
+
+
+void dheap_update(dheap_node_t *node, uint64_t key)
+{
+    dheap_entry_t entry = { key, node };
+    sift(node->heap, node->index, entry);
+}
+
+
+void dheap_remove(dheap_node_t *node)
+{
+    dheap_t *heap = node->heap;
+    size_t pos = node->index;
+
+    if (heap->count) {
+        dheap_entry_t *storage = heap->allocation.memory;
+        /* shrink heap */
+        heap->count--;
+        if (pos != heap->count) {
+            /* move previous last entry into hole left by removed entry */
+            sift(heap, pos, storage[heap->count]);
+        }
+        /* shrink storage (if mostly unused) */
+        dheap_shrink(heap);
+    }
+
+    /* disassociate node from heap */
+    node->heap = NULL;
+    node->index = 0;
+}
+
+
+dheap_node_t *dheap_pop(dheap_t *heap)
+{
+    dheap_node_t *node = dheap_peek(heap);
+
+    if (NULL != node) {
+        dheap_remove(node);
+    }
+
+    return node;
+}
+
+
+void dheap_fini(dheap_t *heap)
+{
+    /* disassociate all remaining nodes from heap */
+    dheap_entry_t *storage = heap->allocation.memory;
+    size_t i;
+    for (i = 0; i < heap->count; ++i) {
+        storage[i].node->heap = NULL;
+        storage[i].node->index = 0;
+    }
+    allocation_free(&(heap->allocation));
+    heap->count = 0;
+    heap->capacity = 0;
+}
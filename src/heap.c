@@ -8,6 +8,8 @@
  * @author Justin R. Cutler <justin.r.cutler@gmail.com>
  */
 
+/* errno, ENOMEM */
+#include <errno.h>
 /* size_t, NULL */
 #include <stddef.h>
 
@@ -17,6 +19,41 @@
 #include <threadless/heap.h>
 
 
+enum {
+    /** minimum non-zero storage capacity (in nodes) */
+    HEAP_MIN_CAPACITY = 16,
+};
+
+
+static int heap_resize(heap_t *heap, size_t capacity)
+{
+    int error = allocation_realloc_array(&(heap->allocation), capacity,
+        sizeof(heap_node_t *));
+    if (!error) {
+        heap->capacity = capacity;
+    }
+    return error;
+}
+
+
+void heap_shrink(heap_t *heap)
+{
+    size_t capacity = heap->capacity;
+
+    /* halve capacity while less than 1/4 full (hysteresis avoids thrashing
+     * when the count oscillates around a power of two)
+     */
+    while (capacity > HEAP_MIN_CAPACITY && heap->count < (capacity >> 2)) {
+        capacity >>= 1;
+    }
+
+    if (capacity != heap->capacity) {
+        /* shrinking failure is harmless */
+        (void) heap_resize(heap, capacity);
+    }
+}
+
+
 static inline void swap(heap_node_t **storage, size_t a, size_t b)
 {
     /* swap elements */
@@ -67,10 +104,52 @@ static void sift_up(const heap_t *heap, size_t pos, size_t end)
 }
 
 
+static void sift_up_early(const heap_t *heap, size_t pos, size_t end)
+{
+    heap_node_t **storage = heap->allocation.memory;
+    size_t child = (pos << 1) + 1;
+    /* swap node with "better" child until neither child is "better" */
+    while (child < end) {
+        size_t right = child + 1;
+        if (right < end && heap->compare(storage[right], storage[child]) < 0) {
+            child = right;
+        }
+        if (heap->compare(storage[child], storage[pos]) >= 0) {
+            break;
+        }
+        swap(storage, pos, child);
+        pos = child;
+        child = (pos << 1) + 1;
+    }
+}
+
+
+int heap_reserve(heap_t *heap, size_t count)
+{
+    size_t capacity = heap->capacity ? heap->capacity : HEAP_MIN_CAPACITY;
+
+    if (count <= heap->capacity) {
+        return 0;
+    }
+
+    /* grow geometrically (amortized O(1) per push) */
+    while (capacity < count && capacity <= (((size_t) -1) >> 1)) {
+        capacity <<= 1;
+    }
+    if (capacity < count) {
+        capacity = count;
+    }
+
+    return heap_resize(heap, capacity);
+}
+
+
 int heap_push(heap_t *heap, heap_node_t *node)
 {
-    int error = allocation_realloc_array(&(heap->allocation), heap->count + 1,
-        sizeof(heap_node_t *));
+    int error = 0;
+    if (heap->count == heap->capacity) {
+        error = heap_reserve(heap, heap->count + 1);
+    }
     if (!error) {
         heap_node_t **storage = heap->allocation.memory;
         /* place item at end of heap */
@@ -84,6 +163,57 @@ int heap_push(heap_t *heap, heap_node_t *node)
 }
 
 
+int heap_push_many(heap_t *heap, heap_node_t *const *nodes, size_t count)
+{
+    size_t start = heap->count;
+    size_t end = start + count;
+    heap_node_t **storage;
+    size_t i;
+
+    if (end < start) {
+        /* integer overflow */
+        errno = ENOMEM;
+        return -1;
+    }
+
+    /* grow storage (once) */
+    if (heap_reserve(heap, end)) {
+        return -1;
+    }
+
+    /* append all nodes */
+    storage = heap->allocation.memory;
+    for (i = start; i < end; ++i) {
+        storage[i] = nodes[i - start];
+        storage[i]->heap = heap;
+        storage[i]->index = i;
+    }
+    heap->count = end;
+
+    if (count >= start) {
+        /* Floyd's heapify (O(n)): sift each parent down, last first */
+        for (i = end >> 1; i-- > 0;) {
+            sift_up(heap, i, end);
+        }
+    } else {
+        /* few new nodes: bubble each into place */
+        for (i = start; i < end; ++i) {
+            sift_down(heap, 0, i);
+        }
+    }
+
+    return 0;
+}
+
+
+int heap_init_from_array(heap_t *heap, allocator_t *allocator,
+    heap_compare_function_t *compare, heap_node_t *const *nodes, size_t count)
+{
+    heap_init(heap, allocator, compare);
+    return heap_push_many(heap, nodes, count);
+}
+
+
 void heap_replace(heap_node_t *old, heap_node_t *node)
 {
     heap_t *heap = old->heap;
@@ -105,22 +235,54 @@ void heap_replace(heap_node_t *old, heap_node_t *node)
 }
 
 
-void heap_remove(heap_node_t *node)
+void heap_update(heap_node_t *node)
+{
+    heap_t *heap = node->heap;
+    size_t pos = node->index;
+    heap_node_t **storage = heap->allocation.memory;
+
+    if (pos > 0 && heap->compare(node, storage[(pos - 1) >> 1]) < 0) {
+        /* "better" than parent */
+        sift_down(heap, 0, pos);
+    } else {
+        sift_up_early(heap, pos, heap->count);
+    }
+}
+
+
+void heap_decrease_key(heap_node_t *node)
+{
+    sift_down(node->heap, 0, node->index);
+}
+
+
+void heap_increase_key(heap_node_t *node)
 {
     heap_t *heap = node->heap;
+    sift_up_early(heap, node->index, heap->count);
+}
+
+
+static void remove_node(heap_t *heap, heap_node_t *node)
+{
     size_t pos = node->index;
 
     if (heap->count) {
         /* shrink heap */
         heap->count--;
         if (pos != heap->count) {
+            heap_node_t **storage = heap->allocation.memory;
             /* exchange previous last element for removed element */
-            swap(heap->allocation.memory, pos, heap->count);
-            /* shrink storage */
-            (void) allocation_realloc_array(&(heap->allocation), heap->count,
-                sizeof(heap_node_t *));
-            /* restore heap invariant */
-            sift_up(heap, pos, heap->count);
+            swap(storage, pos, heap->count);
+            /* restore heap invariant (the previous last element may be
+             * "better" than the removed element's parent)
+             */
+            if (pos > 0 &&
+                heap->compare(storage[pos], storage[(pos - 1) >> 1]) < 0) {
+                sift_down(heap, 0, pos);
+            } else {
+                sift_up(heap, pos, heap->count);
+            }
         }
     }
 
@@ -130,6 +292,17 @@ void heap_remove(heap_node_t *node)
 }
 
 
+void heap_remove(heap_node_t *node)
+{
+    heap_t *heap = node->heap;
+
+    remove_node(heap, node);
+
+    /* shrink storage (if mostly unused) */
+    heap_shrink(heap);
+}
+
+
 heap_node_t *heap_pop(heap_t *heap)
 {
     heap_node_t *node = heap_peek(heap);
@@ -142,6 +315,30 @@ heap_node_t *heap_pop(heap_t *heap)
 }
 
 
+size_t heap_pop_until(heap_t *heap, const heap_node_t *threshold,
+    heap_node_t **nodes, size_t max)
+{
+    size_t count = 0;
+
+    while (count < max && heap->count) {
+        heap_node_t *node = *(heap_node_t **) heap->allocation.memory;
+        if (heap->compare(node, threshold) > 0) {
+            /* "best" node is "worse" than threshold */
+            break;
+        }
+        remove_node(heap, node);
+        nodes[count++] = node;
+    }
+
+    if (count) {
+        /* shrink storage (once) */
+        heap_shrink(heap);
+    }
+
+    return count;
+}
+
+
 void heap_fini(heap_t *heap)
 {
     /* diassociate all remaining nodes from heap */
@@ -152,4 +349,6 @@ void heap_fini(heap_t *heap)
         storage[i]->index = 0;
     }
     allocation_free(&(heap->allocation));
+    heap->count = 0;
+    heap->capacity = 0;
 }
@@ -0,0 +1,1290 @@
+/* threadless.io
+ * Copyright (c) 2016 Justin R. Cutler
+ * Licensed under the MIT License. See LICENSE file in the project root for
+ * full license information.
+ */
+/** @file
+ * event loop implementation (@c epoll(7) and @c io_uring(7))
+ * @author Justin R. Cutler <justin.r.cutler@gmail.com>
+ */
+
+#define _DEFAULT_SOURCE
+
+/* HAVE_* */
+#include "config.h"
+
+/* errno, EAGAIN, EWOULDBLOCK, EINTR, EINPROGRESS, EEXIST, EPERM, EDEADLK,
+ * EINVAL, EBUSY, ENOSYS, ETIME, ETIMEDOUT, ECANCELED
+ */
+#include <errno.h>
+/* NULL, size_t */
+#include <stddef.h>
+/* uint8_t, uint32_t, uint64_t, intptr_t, uintptr_t, UINT64_MAX */
+#include <stdint.h>
+/* memset */
+#include <string.h>
+
+/* fcntl, F_GETFL, F_SETFL, O_NONBLOCK */
+#include <fcntl.h>
+/* POLLIN, POLLOUT */
+#include <poll.h>
+/* epoll_create1, epoll_ctl, epoll_wait, struct epoll_event, EPOLL* */
+#include <sys/epoll.h>
+/* mmap, munmap, PROT_*, MAP_* */
+#include <sys/mman.h>
+/* accept, connect, getsockopt, SOL_SOCKET, SO_ERROR */
+#include <sys/socket.h>
+/* __NR_io_uring_* */
+#include <sys/syscall.h>
+/* read, write, close, syscall */
+#include <unistd.h>
+
+#ifdef HAVE_IO_URING
+/* struct io_uring_*, IORING_*, IOSQE_* */
+# include <linux/io_uring.h>
+#endif
+
+/* allocation_init, allocation_realloc_array, allocation_free */
+#include <threadless/allocation.h>
+/* container_of */
+#include <threadless/container_of.h>
+/* coroutine_yield, coroutine_spawn, coroutine_ready, scheduler_*,
+ * coroutine_stack_shared
+ */
+#include <threadless/coroutine.h>
+/* timer_heap_create */
+#include <threadless/timer_heap.h>
+/* timer_wheel_create */
+#include <threadless/timer_wheel.h>
+/* timer_queue_*, timer_init, timer_now */
+#include <threadless/timer_queue.h>
+/* ... */
+#include <threadless/loop.h>
+
+
+#ifndef HAVE_EPOLL
+# error Need epoll
+#endif
+
+
+enum {
+    /** maximum number of events handled per epoll_wait() */
+    LOOP_EVENTS = 64,
+    /** io_uring submission queue size */
+    LOOP_RING_ENTRIES = 256,
+    /** maximum number of coroutines resumed between polls */
+    LOOP_RESUMES = 64,
+    /** maximum read/write size (like Linux's MAX_RW_COUNT) */
+    LOOP_MAX_RW = 0x7FFFF000,
+    /** nanoseconds per millisecond */
+    LOOP_NS_PER_MS = 1000000,
+};
+
+
+/** no deadline */
+#define NO_DEADLINE ((uint64_t) 0)
+
+
+#ifdef HAVE_IO_URING
+/** required io_uring features (implying Linux 5.11 and its operations) */
+#define RING_FEATURES (IORING_FEAT_NODROP | IORING_FEAT_RW_CUR_POS | \
+    IORING_FEAT_FAST_POLL | IORING_FEAT_EXT_ARG)
+
+
+/** io_uring instance */
+typedef struct {
+    /** io_uring file descriptor */
+    int fd;
+    /** number of queued (not yet submitted) entries */
+    unsigned pending;
+    /** submission queue head (written by kernel) */
+    unsigned *sq_head;
+    /** submission queue tail (written by us) */
+    unsigned *sq_tail;
+    /** submission queue index mask */
+    unsigned sq_mask;
+    /** number of submission queue entries */
+    unsigned sq_entries;
+    /** submission queue entries */
+    struct io_uring_sqe *sqes;
+    /** completion queue head (written by us) */
+    unsigned *cq_head;
+    /** completion queue tail (written by kernel) */
+    unsigned *cq_tail;
+    /** completion queue index mask */
+    unsigned cq_mask;
+    /** completion queue entries */
+    struct io_uring_cqe *cqes;
+    /** submission queue ring mapping */
+    void *sq_ring;
+    /** size of submission queue ring mapping */
+    size_t sq_ring_size;
+    /** completion queue ring mapping (may equal @p sq_ring) */
+    void *cq_ring;
+    /** size of completion queue ring mapping */
+    size_t cq_ring_size;
+    /** size of submission queue entries mapping */
+    size_t sqes_size;
+} ring_t;
+#endif
+
+
+/** waiting coroutine (referenced by the kernel and by timers, so kept off
+ * the coroutine stack, which may be shared and copied out while suspended)
+ */
+typedef struct waiter waiter_t;
+struct waiter {
+    /** memory containing this waiter */
+    allocation_t allocation;
+    /** next idle waiter */
+    waiter_t *next;
+    /** event loop */
+    loop_t *loop;
+    /** waiting coroutine */
+    coroutine_t *coro;
+    /** file descriptor (if waiting for one) */
+    int fd;
+    /** non-zero if deadline has passed */
+    int timed_out;
+    /** non-zero once woken (coroutine is ready) */
+    int done;
+    /** operation result (io_uring only) */
+    int result;
+    /** deadline (or wake-up) timer */
+    timer_event_t timer;
+};
+
+
+struct loop {
+    /** memory containing this loop */
+    allocation_t allocation;
+    /** backend (LOOP_BACKEND_*) */
+    int backend;
+    /** epoll instance (if backend is LOOP_BACKEND_EPOLL) */
+    int epfd;
+    /** scheduler of coroutines owned by this loop */
+    scheduler_t *scheduler;
+    /** number of waiting (or sleeping) coroutines */
+    size_t waiting;
+    /** deadline of next pseudo-blocking operation (see loop_timeout()) */
+    uint64_t deadline;
+    /** pending timers, by class (LOOP_TIMERS_*) */
+    timer_queue_t *timers[LOOP_TIMER_CLASSES];
+    /** idle waiters (for reuse) */
+    waiter_t *idle_waiters;
+#ifdef HAVE_IO_URING
+    /** io_uring instance (if backend is LOOP_BACKEND_IO_URING) */
+    ring_t ring;
+    /** registered file index by file descriptor (or -1) */
+    allocation_t files;
+#endif
+    /** ready events */
+    struct epoll_event events[LOOP_EVENTS];
+};
+
+
+#ifdef HAVE_IO_URING
+static void ring_fini(ring_t *ring)
+{
+    if (NULL != ring->sqes) {
+        (void) munmap(ring->sqes, ring->sqes_size);
+    }
+    if (NULL != ring->cq_ring && ring->cq_ring != ring->sq_ring) {
+        (void) munmap(ring->cq_ring, ring->cq_ring_size);
+    }
+    if (NULL != ring->sq_ring) {
+        (void) munmap(ring->sq_ring, ring->sq_ring_size);
+    }
+    if (ring->fd >= 0) {
+        (void) close(ring->fd);
+    }
+}
+
+
+static void *ring_map(int fd, size_t size, off_t offset)
+{
+    void *memory = mmap(NULL, size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, fd, offset);
+    return (MAP_FAILED != memory) ? memory : NULL;
+}
+
+
+static int ring_init(ring_t *ring, unsigned entries)
+{
+    struct io_uring_params params;
+    unsigned *array;
+    char *sq;
+    char *cq;
+    long fd;
+    unsigned i;
+
+    memset(ring, 0, sizeof(*ring));
+    memset(&params, 0, sizeof(params));
+    fd = syscall(__NR_io_uring_setup, entries, &params);
+    ring->fd = (int) fd;
+    if (fd < 0) {
+        return -1;
+    }
+    if ((params.features & RING_FEATURES) != RING_FEATURES) {
+        /* kernel too old */
+        ring_fini(ring);
+        errno = ENOSYS;
+        return -1;
+    }
+
+    /* map rings and submission queue entries */
+    ring->sq_ring_size = params.sq_off.array +
+        params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params.cq_off.cqes +
+        params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_ring_size > ring->sq_ring_size) {
+            ring->sq_ring_size = ring->cq_ring_size;
+        }
+        ring->cq_ring_size = ring->sq_ring_size;
+    }
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sq_ring = ring_map(ring->fd, ring->sq_ring_size, IORING_OFF_SQ_RING);
+    if (NULL != ring->sq_ring) {
+        ring->cq_ring = (params.features & IORING_FEAT_SINGLE_MMAP) ?
+            ring->sq_ring :
+            ring_map(ring->fd, ring->cq_ring_size, IORING_OFF_CQ_RING);
+    }
+    if (NULL != ring->cq_ring) {
+        ring->sqes = ring_map(ring->fd, ring->sqes_size, IORING_OFF_SQES);
+    }
+    if (NULL == ring->sqes) {
+        int error = errno;
+        ring_fini(ring);
+        errno = error;
+        return -1;
+    }
+
+    sq = ring->sq_ring;
+    cq = ring->cq_ring;
+    ring->sq_head = (unsigned *)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sq_mask = *(unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sq_entries = *(unsigned *)(sq + params.sq_off.ring_entries);
+    ring->cq_head = (unsigned *)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    ring->cq_mask = *(unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+    /* submission queue slot i always holds entry i */
+    array = (unsigned *)(sq + params.sq_off.array);
+    for (i = 0; i < ring->sq_entries; ++i) {
+        array[i] = i;
+    }
+
+    return 0;
+}
+
+
+static int ring_enter(ring_t *ring, unsigned wait, unsigned flags,
+    const void *arg, size_t size)
+{
+    long result = syscall(__NR_io_uring_enter, ring->fd, ring->pending, wait,
+        flags, arg, size);
+    if (result < 0) {
+        return -1;
+    }
+    ring->pending -= (unsigned) result;
+    return 0;
+}
+
+
+static int ring_register(ring_t *ring, unsigned opcode, const void *arg,
+    unsigned count)
+{
+    return (syscall(__NR_io_uring_register, ring->fd, opcode, arg, count) < 0) ?
+        -1 : 0;
+}
+
+
+static struct io_uring_sqe *ring_get_sqe(ring_t *ring)
+{
+    unsigned tail = *ring->sq_tail;
+    struct io_uring_sqe *sqe;
+
+    if (tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) >=
+        ring->sq_entries) {
+        /* submission queue full: submit queued entries first */
+        if (ring_enter(ring, 0, 0, NULL, 0)) {
+            return NULL;
+        }
+        if (tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) >=
+            ring->sq_entries) {
+            errno = EBUSY;
+            return NULL;
+        }
+    }
+
+    sqe = &(ring->sqes[tail & ring->sq_mask]);
+    memset(sqe, 0, sizeof(*sqe));
+
+    return sqe;
+}
+
+
+static inline void ring_queue(ring_t *ring)
+{
+    /* publish entry (submitted in batches by loop_run()) */
+    __atomic_store_n(ring->sq_tail, *ring->sq_tail + 1, __ATOMIC_RELEASE);
+    ring->pending++;
+}
+#endif
+
+
+static void loop_free(loop_t *loop)
+{
+    allocation_t allocation = loop->allocation;
+    int i;
+
+    while (NULL != loop->idle_waiters) {
+        waiter_t *waiter = loop->idle_waiters;
+        allocation_t waiter_allocation = waiter->allocation;
+        loop->idle_waiters = waiter->next;
+        allocation_free(&waiter_allocation);
+    }
+#ifdef HAVE_IO_URING
+    allocation_free(&(loop->files));
+#endif
+    if (NULL != loop->scheduler) {
+        scheduler_destroy(loop->scheduler);
+    }
+    for (i = 0; i < LOOP_TIMER_CLASSES; ++i) {
+        if (NULL != loop->timers[i]) {
+            timer_queue_destroy(loop->timers[i]);
+        }
+    }
+    allocation_free(&allocation);
+}
+
+
+loop_t *loop_create_backend(allocator_t *allocator, int backend)
+{
+    loop_t *loop;
+    allocation_t allocation;
+
+    if (LOOP_BACKEND_DEFAULT != backend && LOOP_BACKEND_EPOLL != backend &&
+        LOOP_BACKEND_IO_URING != backend) {
+        errno = EINVAL;
+        return NULL;
+    }
+#ifndef HAVE_IO_URING
+    if (LOOP_BACKEND_IO_URING == backend) {
+        errno = ENOSYS;
+        return NULL;
+    }
+#endif
+
+    allocation_init(&allocation, allocator);
+    if (allocation_realloc_array(&allocation, 1, sizeof(*loop))) {
+        return NULL;
+    }
+
+    loop = allocation.memory;
+    loop->allocation = allocation;
+    loop->backend = LOOP_BACKEND_EPOLL;
+    loop->epfd = -1;
+    loop->waiting = 0;
+    loop->deadline = NO_DEADLINE;
+    loop->idle_waiters = NULL;
+#ifdef HAVE_IO_URING
+    allocation_init(&(loop->files), allocator);
+#endif
+    /* exact sleeps; coarse (1 ms), usually cancelled or refreshed deadlines */
+    loop->timers[LOOP_TIMERS_SLEEP] = timer_heap_create(allocator);
+    loop->timers[LOOP_TIMERS_TIMEOUT] = timer_wheel_create(allocator, 0);
+    loop->scheduler = scheduler_create(allocator);
+    if (NULL == loop->timers[LOOP_TIMERS_SLEEP] ||
+        NULL == loop->timers[LOOP_TIMERS_TIMEOUT] ||
+        NULL == loop->scheduler) {
+        int error = errno;
+        loop_free(loop);
+        errno = error;
+        return NULL;
+    }
+
+#ifdef HAVE_IO_URING
+    if (LOOP_BACKEND_EPOLL != backend) {
+        if (!ring_init(&(loop->ring), LOOP_RING_ENTRIES)) {
+            loop->backend = LOOP_BACKEND_IO_URING;
+            return loop;
+        }
+        if (LOOP_BACKEND_IO_URING == backend) {
+            int error = errno;
+            loop_free(loop);
+            errno = error;
+            return NULL;
+        }
+        /* fall back to epoll */
+    }
+#endif
+
+    loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epfd < 0) {
+        int error = errno;
+        loop_free(loop);
+        errno = error;
+        return NULL;
+    }
+
+    return loop;
+}
+
+
+loop_t *loop_create(allocator_t *allocator)
+{
+    return loop_create_backend(allocator, LOOP_BACKEND_DEFAULT);
+}
+
+
+int loop_backend(const loop_t *loop)
+{
+    return loop->backend;
+}
+
+
+void loop_destroy(loop_t *loop)
+{
+#ifdef HAVE_IO_URING
+    if (LOOP_BACKEND_IO_URING == loop->backend) {
+        ring_fini(&(loop->ring));
+    }
+#endif
+    if (loop->epfd >= 0) {
+        (void) close(loop->epfd);
+    }
+    loop_free(loop);
+}
+
+
+int loop_timer_queue(loop_t *loop, int timer_class, timer_queue_t *queue)
+{
+    if (timer_class < 0 || timer_class >= LOOP_TIMER_CLASSES ||
+        NULL == queue) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (UINT64_MAX != timer_queue_next(loop->timers[timer_class])) {
+        /* pending timers would be lost */
+        errno = EBUSY;
+        return -1;
+    }
+
+    timer_queue_destroy(loop->timers[timer_class]);
+    loop->timers[timer_class] = queue;
+
+    return 0;
+}
+
+
+scheduler_t *loop_scheduler(loop_t *loop)
+{
+    return loop->scheduler;
+}
+
+
+void loop_spawn(loop_t *loop, coroutine_t *coro, void *data)
+{
+    coroutine_spawn(loop->scheduler, coro, data);
+}
+
+
+static waiter_t *waiter_arm(loop_t *loop, coroutine_t *coro,
+    int timer_class, uint64_t deadline, timer_function_t *function)
+{
+    waiter_t *waiter = loop->idle_waiters;
+
+    if (NULL != waiter) {
+        loop->idle_waiters = waiter->next;
+    } else {
+        allocation_t allocation;
+        allocation_init(&allocation, loop->allocation.allocator);
+        if (allocation_realloc_array(&allocation, 1, sizeof(*waiter))) {
+            return NULL;
+        }
+        waiter = allocation.memory;
+        waiter->allocation = allocation;
+    }
+
+    waiter->loop = loop;
+    waiter->coro = coro;
+    waiter->fd = -1;
+    waiter->timed_out = 0;
+    waiter->done = 0;
+    waiter->result = 0;
+    timer_init(&(waiter->timer), function);
+    if (NO_DEADLINE != deadline &&
+        timer_queue_add(loop->timers[timer_class], &(waiter->timer),
+            deadline)) {
+        waiter->next = loop->idle_waiters;
+        loop->idle_waiters = waiter;
+        return NULL;
+    }
+
+    return waiter;
+}
+
+
+static void waiter_release(waiter_t *waiter)
+{
+    loop_t *loop = waiter->loop;
+
+    /* operation completed first (or never waited): cancel deadline */
+    timer_queue_cancel(&(waiter->timer));
+    waiter->next = loop->idle_waiters;
+    loop->idle_waiters = waiter;
+}
+
+
+static void waiter_yield(waiter_t *waiter)
+{
+    loop_t *loop = waiter->loop;
+
+    /* wait for waiter_wake() (ignoring unrelated coroutine_ready() calls) */
+    loop->waiting++;
+    do {
+        (void) coroutine_yield(waiter->coro, NULL);
+    } while (!waiter->done);
+    loop->waiting--;
+}
+
+
+static void waiter_wake(waiter_t *waiter)
+{
+    waiter->done = 1;
+    coroutine_ready(waiter->coro, NULL);
+}
+
+
+static inline uint64_t loop_deadline(loop_t *loop)
+{
+    /* consume deadline set via loop_timeout() */
+    uint64_t deadline = loop->deadline;
+    loop->deadline = NO_DEADLINE;
+    return deadline;
+}
+
+
+static void wake_expired(timer_event_t *timer)
+{
+    waiter_wake(container_of(timer, waiter_t, timer));
+}
+
+
+static int epoll_poll(loop_t *loop, uint64_t timeout)
+{
+    int milliseconds = -1;
+    int count;
+    int i;
+
+    if (UINT64_MAX != timeout) {
+        /* round up (to avoid waking up early, and spinning) */
+        timeout = (timeout + LOOP_NS_PER_MS - 1) / LOOP_NS_PER_MS;
+        milliseconds = (timeout < 0x7FFFFFFF) ? (int) timeout : 0x7FFFFFFF;
+    }
+
+    count = epoll_wait(loop->epfd, loop->events, LOOP_EVENTS, milliseconds);
+    if (count < 0) {
+        return -1;
+    }
+
+    for (i = 0; i < count; ++i) {
+        waiter_wake(loop->events[i].data.ptr);
+    }
+
+    return 0;
+}
+
+
+static void epoll_expired(timer_event_t *timer)
+{
+    waiter_t *waiter = container_of(timer, waiter_t, timer);
+
+    if (!waiter->done) {
+        /* disarm interest, then wake waiter */
+        (void) epoll_ctl(waiter->loop->epfd, EPOLL_CTL_DEL, waiter->fd, NULL);
+        waiter->timed_out = 1;
+        waiter_wake(waiter);
+    }
+}
+
+
+static int epoll_wait_fd(loop_t *loop, coroutine_t *coro, int fd, int events,
+    uint64_t deadline)
+{
+    waiter_t *waiter = waiter_arm(loop, coro, LOOP_TIMERS_TIMEOUT, deadline,
+        epoll_expired);
+    struct epoll_event event;
+    int error = 0;
+
+    if (NULL == waiter) {
+        return -1;
+    }
+    waiter->fd = fd;
+
+    event.events = EPOLLONESHOT;
+    if (events & LOOP_READ) {
+        event.events |= EPOLLIN;
+    }
+    if (events & LOOP_WRITE) {
+        event.events |= EPOLLOUT;
+    }
+    event.data.ptr = waiter;
+
+    /* register (or re-arm, after a previous one-shot wait) */
+    if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, fd, &event)) {
+        if (EEXIST == errno) {
+            error = epoll_ctl(loop->epfd, EPOLL_CTL_MOD, fd, &event);
+        } else if (EPERM == errno) {
+            /* file does not support epoll (e.g., regular file): always
+             * ready
+             */
+            waiter_release(waiter);
+            return 0;
+        } else {
+            error = -1;
+        }
+    }
+
+    if (!error) {
+        waiter_yield(waiter);
+        if (waiter->timed_out) {
+            errno = ETIMEDOUT;
+            error = -1;
+        }
+    }
+    waiter_release(waiter);
+
+    return error;
+}
+
+
+#ifdef HAVE_IO_URING
+static int uring_poll(loop_t *loop, uint64_t timeout)
+{
+    ring_t *ring = &(loop->ring);
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    unsigned head;
+    unsigned tail;
+
+    memset(&arg, 0, sizeof(arg));
+    if (UINT64_MAX != timeout) {
+        ts.tv_sec = (long long)(timeout / (LOOP_NS_PER_MS * 1000ULL));
+        ts.tv_nsec = (long long)(timeout % (LOOP_NS_PER_MS * 1000ULL));
+        arg.ts = (uintptr_t) &ts;
+    }
+
+    /* submit queued entries, and wait for at least one completion (or
+     * timeout)
+     */
+    if (ring_enter(ring, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+        &arg, sizeof(arg)) && ETIME != errno) {
+        return -1;
+    }
+
+    /* reap completions, waking each waiter with its result */
+    head = *ring->cq_head;
+    tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+        struct io_uring_cqe *cqe = &(ring->cqes[head & ring->cq_mask]);
+        waiter_t *waiter = (waiter_t *)(uintptr_t) cqe->user_data;
+        if (NULL != waiter) {
+            waiter->result = cqe->res;
+            waiter_wake(waiter);
+        }
+        ++head;
+    }
+    __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+
+static struct io_uring_sqe *uring_prepare(loop_t *loop, int opcode, int fd)
+{
+    struct io_uring_sqe *sqe = ring_get_sqe(&(loop->ring));
+
+    if (NULL != sqe) {
+        const int *files = loop->files.memory;
+        sqe->opcode = (uint8_t) opcode;
+        sqe->fd = fd;
+        if (fd >= 0 && (size_t) fd < loop->files.size / sizeof(int) &&
+            files[fd] >= 0) {
+            /* use registered file */
+            sqe->fd = files[fd];
+            sqe->flags |= IOSQE_FIXED_FILE;
+        }
+    }
+
+    return sqe;
+}
+
+
+static void uring_expired(timer_event_t *timer)
+{
+    waiter_t *waiter = container_of(timer, waiter_t, timer);
+
+    /* cancel operation (which then completes, typically with -ECANCELED) */
+    if (!waiter->done) {
+        struct io_uring_sqe *sqe = ring_get_sqe(&(waiter->loop->ring));
+        if (NULL == sqe) {
+            /* submission queue still full: retry once loop_run() has
+             * submitted queued entries (and reaped completions)
+             */
+            (void) timer_queue_add(
+                waiter->loop->timers[LOOP_TIMERS_TIMEOUT], timer,
+                timer_now());
+            return;
+        }
+        waiter->timed_out = 1;
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->addr = (uintptr_t) waiter;
+        ring_queue(&(waiter->loop->ring));
+    }
+}
+
+
+static int uring_complete(loop_t *loop, coroutine_t *coro,
+    struct io_uring_sqe *sqe, uint64_t deadline)
+{
+    waiter_t *waiter = waiter_arm(loop, coro, LOOP_TIMERS_TIMEOUT, deadline,
+        uring_expired);
+    int result;
+
+    if (NULL == waiter) {
+        /* entry is discarded (not yet queued) */
+        return -errno;
+    }
+    sqe->user_data = (uintptr_t) waiter;
+    ring_queue(&(loop->ring));
+
+    /* wait for uring_poll() to wake this coroutine with the result */
+    waiter_yield(waiter);
+    result = waiter->result;
+    if (waiter->timed_out && -ECANCELED == result) {
+        result = -ETIMEDOUT;
+    }
+    waiter_release(waiter);
+
+    return result;
+}
+
+
+static int uring_wait(loop_t *loop, coroutine_t *coro, int fd, int events,
+    uint64_t deadline)
+{
+    struct io_uring_sqe *sqe = uring_prepare(loop, IORING_OP_POLL_ADD, fd);
+    uint32_t mask = 0;
+    int result;
+
+    if (NULL == sqe) {
+        return -1;
+    }
+    if (events & LOOP_READ) {
+        mask |= POLLIN;
+    }
+    if (events & LOOP_WRITE) {
+        mask |= POLLOUT;
+    }
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    mask = (mask << 16) | (mask >> 16);
+#endif
+    sqe->poll32_events = mask;
+
+    result = uring_complete(loop, coro, sqe, deadline);
+    if (result < 0) {
+        errno = -result;
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static ssize_t uring_rw(loop_t *loop, coroutine_t *coro, int opcode, int fd,
+    const void *buf, size_t count, unsigned index)
+{
+    uint64_t deadline = loop_deadline(loop);
+
+    for (;;) {
+        struct io_uring_sqe *sqe = uring_prepare(loop, opcode, fd);
+        int result;
+
+        if (NULL == sqe) {
+            return -1;
+        }
+        sqe->addr = (uintptr_t) buf;
+        sqe->len = (unsigned)((count < LOOP_MAX_RW) ? count : LOOP_MAX_RW);
+        sqe->off = (uint64_t) -1;
+        sqe->buf_index = (uint16_t) index;
+
+        result = uring_complete(loop, coro, sqe, deadline);
+        if (result >= 0) {
+            return result;
+        }
+        if (-EAGAIN == result || -EWOULDBLOCK == result) {
+            /* non-blocking file not ready: wait for readiness, then retry */
+            int events = (IORING_OP_READ == opcode ||
+                IORING_OP_READ_FIXED == opcode) ? LOOP_READ : LOOP_WRITE;
+            if (uring_wait(loop, coro, fd, events, deadline)) {
+                return -1;
+            }
+        } else if (-EINTR != result) {
+            errno = -result;
+            return -1;
+        }
+    }
+}
+
+
+/* io_uring reads/writes user memory after the coroutine suspends, and a
+ * shared stack is copied out (and reused) by then, so shared coroutines
+ * fall back to readiness waits (IORING_OP_POLL_ADD) plus plain syscalls
+ */
+static inline bool uring_direct(const loop_t *loop, const coroutine_t *coro)
+{
+    return LOOP_BACKEND_IO_URING == loop->backend &&
+        !coroutine_stack_shared(coro);
+}
+#endif
+
+
+static int wait_fd(loop_t *loop, coroutine_t *coro, int fd, int events,
+    uint64_t deadline)
+{
+#ifdef HAVE_IO_URING
+    if (LOOP_BACKEND_IO_URING == loop->backend) {
+        return uring_wait(loop, coro, fd, events, deadline);
+    }
+#endif
+    return epoll_wait_fd(loop, coro, fd, events, deadline);
+}
+
+
+int loop_run(loop_t *loop)
+{
+    for (;;) {
+        uint64_t timeout = UINT64_MAX;
+        uint64_t next = UINT64_MAX;
+        int error;
+        int i;
+
+        /* run a bounded batch of ready coroutines, then poll */
+        (void) scheduler_run(loop->scheduler, LOOP_RESUMES);
+        if (!scheduler_count(loop->scheduler)) {
+            break;
+        }
+
+        for (i = 0; i < LOOP_TIMER_CLASSES; ++i) {
+            uint64_t class_next = timer_queue_next(loop->timers[i]);
+            next = (class_next < next) ? class_next : next;
+        }
+        if (scheduler_ready_count(loop->scheduler)) {
+            /* more coroutines are ready: poll without blocking */
+            timeout = 0;
+        } else if (!loop->waiting) {
+            /* no coroutine can ever be resumed */
+            errno = EDEADLK;
+            return -1;
+        } else if (UINT64_MAX != next) {
+            /* wait no longer than until the earliest deadline */
+            uint64_t now = timer_now();
+            timeout = (next > now) ? next - now : 0;
+        }
+
+#ifdef HAVE_IO_URING
+        if (LOOP_BACKEND_IO_URING == loop->backend) {
+            error = uring_poll(loop, timeout);
+        } else
+#endif
+        {
+            error = epoll_poll(loop, timeout);
+        }
+        if (error && EINTR != errno) {
+            return -1;
+        }
+
+        for (i = 0; i < LOOP_TIMER_CLASSES; ++i) {
+            (void) timer_queue_expire(loop->timers[i], timer_now());
+        }
+    }
+
+    return 0;
+}
+
+
+/* deadline ms from now, saturating to NO_DEADLINE (never expires) where
+ * it would reach UINT64_MAX (no pending timers, per timer_queue_next())
+ */
+static uint64_t deadline_after(unsigned long ms)
+{
+    uint64_t now = timer_now();
+
+    if (ms >= (UINT64_MAX - now) / LOOP_NS_PER_MS) {
+        return NO_DEADLINE;
+    }
+    return now + (uint64_t) ms * LOOP_NS_PER_MS;
+}
+
+
+void loop_timeout(loop_t *loop, long ms)
+{
+    loop->deadline = (ms >= 0) ? deadline_after((unsigned long) ms) :
+        NO_DEADLINE;
+}
+
+
+int loop_sleep(loop_t *loop, coroutine_t *coro, unsigned long ms)
+{
+    waiter_t *waiter = waiter_arm(loop, coro, LOOP_TIMERS_SLEEP,
+        deadline_after(ms), wake_expired);
+
+    if (NULL == waiter) {
+        return -1;
+    }
+    waiter_yield(waiter);
+    waiter_release(waiter);
+
+    return 0;
+}
+
+
+int loop_wait(loop_t *loop, coroutine_t *coro, int fd, int events)
+{
+    return wait_fd(loop, coro, fd, events, loop_deadline(loop));
+}
+
+
+int loop_register_buffers(loop_t *loop, const struct iovec *iovecs,
+    unsigned count)
+{
+#ifdef HAVE_IO_URING
+    if (LOOP_BACKEND_IO_URING == loop->backend) {
+        return ring_register(&(loop->ring), IORING_REGISTER_BUFFERS, iovecs,
+            count);
+    }
+#endif
+    (void) loop;
+    (void) iovecs;
+    (void) count;
+    return 0;
+}
+
+
+int loop_unregister_buffers(loop_t *loop)
+{
+#ifdef HAVE_IO_URING
+    if (LOOP_BACKEND_IO_URING == loop->backend) {
+        return ring_register(&(loop->ring), IORING_UNREGISTER_BUFFERS, NULL,
+            0);
+    }
+#endif
+    (void) loop;
+    return 0;
+}
+
+
+int loop_register_files(loop_t *loop, const int *fds, unsigned count)
+{
+#ifdef HAVE_IO_URING
+    if (LOOP_BACKEND_IO_URING == loop->backend) {
+        int *files;
+        int max = -1;
+        unsigned i;
+
+        if (NULL != loop->files.memory) {
+            /* already registered */
+            errno = EBUSY;
+            return -1;
+        }
+
+        /* build map from file descriptor to registered file index */
+        for (i = 0; i < count; ++i) {
+            if (fds[i] > max) {
+                max = fds[i];
+            }
+        }
+        if (max < 0) {
+            errno = EINVAL;
+            return -1;
+        }
+        if (allocation_realloc_array(&(loop->files), (size_t) max + 1,
+            sizeof(int))) {
+            return -1;
+        }
+        files = loop->files.memory;
+        for (i = 0; i <= (unsigned) max; ++i) {
+            files[i] = -1;
+        }
+        for (i = 0; i < count; ++i) {
+            if (fds[i] >= 0) {
+                files[fds[i]] = (int) i;
+            }
+        }
+
+        if (ring_register(&(loop->ring), IORING_REGISTER_FILES, fds, count)) {
+            int error = errno;
+            allocation_free(&(loop->files));
+            errno = error;
+            return -1;
+        }
+        return 0;
+    }
+#endif
+    (void) loop;
+    (void) fds;
+    (void) count;
+    return 0;
+}
+
+
+int loop_unregister_files(loop_t *loop)
+{
+#ifdef HAVE_IO_URING
+    if (LOOP_BACKEND_IO_URING == loop->backend &&
+        NULL != loop->files.memory) {
+        if (ring_register(&(loop->ring), IORING_UNREGISTER_FILES, NULL, 0)) {
+            return -1;
+        }
+        allocation_free(&(loop->files));
+    }
+#endif
+    (void) loop;
+    return 0;
+}
+
+
+static inline int would_block(int error)
+{
+    return EAGAIN == error || EWOULDBLOCK == error;
+}
+
+
+ssize_t loop_read(loop_t *loop, coroutine_t *coro, int fd, void *buf,
+    size_t count)
+{
+    uint64_t deadline;
+
+#ifdef HAVE_IO_URING
+    if (uring_direct(loop, coro)) {
+        return uring_rw(loop, coro, IORING_OP_READ, fd, buf, count, 0);
+    }
+#endif
+    deadline = loop_deadline(loop);
+    for (;;) {
+        ssize_t result = read(fd, buf, count);
+        if (result >= 0 || (EINTR != errno && !would_block(errno))) {
+            return result;
+        }
+        if (EINTR != errno &&
+            wait_fd(loop, coro, fd, LOOP_READ, deadline)) {
+            return -1;
+        }
+    }
+}
+
+
+ssize_t loop_write(loop_t *loop, coroutine_t *coro, int fd, const void *buf,
+    size_t count)
+{
+    uint64_t deadline;
+
+#ifdef HAVE_IO_URING
+    if (uring_direct(loop, coro)) {
+        return uring_rw(loop, coro, IORING_OP_WRITE, fd, buf, count, 0);
+    }
+#endif
+    deadline = loop_deadline(loop);
+    for (;;) {
+        ssize_t result = write(fd, buf, count);
+        if (result >= 0 || (EINTR != errno && !would_block(errno))) {
+            return result;
+        }
+        if (EINTR != errno &&
+            wait_fd(loop, coro, fd, LOOP_WRITE, deadline)) {
+            return -1;
+        }
+    }
+}
+
+
+ssize_t loop_read_fixed(loop_t *loop, coroutine_t *coro, int fd, void *buf,
+    size_t count, unsigned index)
+{
+#ifdef HAVE_IO_URING
+    if (uring_direct(loop, coro)) {
+        return uring_rw(loop, coro, IORING_OP_READ_FIXED, fd, buf, count,
+            index);
+    }
+#endif
+    (void) index;
+    return loop_read(loop, coro, fd, buf, count);
+}
+
+
+ssize_t loop_write_fixed(loop_t *loop, coroutine_t *coro, int fd,
+    const void *buf, size_t count, unsigned index)
+{
+#ifdef HAVE_IO_URING
+    if (uring_direct(loop, coro)) {
+        return uring_rw(loop, coro, IORING_OP_WRITE_FIXED, fd, buf, count,
+            index);
+    }
+#endif
+    (void) index;
+    return loop_write(loop, coro, fd, buf, count);
+}
+
+
+static int set_nonblocking(int fd)
+{
+    int flags = fcntl(fd, F_GETFL);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK)) {
+        int error = errno;
+        (void) close(fd);
+        errno = error;
+        return -1;
+    }
+    return fd;
+}
+
+
+int loop_accept(loop_t *loop, coroutine_t *coro, int fd,
+    struct sockaddr *addr, socklen_t *addrlen)
+{
+    uint64_t deadline = loop_deadline(loop);
+
+#ifdef HAVE_IO_URING
+    if (uring_direct(loop, coro)) {
+        for (;;) {
+            struct io_uring_sqe *sqe = uring_prepare(loop, IORING_OP_ACCEPT,
+                fd);
+            int result;
+
+            if (NULL == sqe) {
+                return -1;
+            }
+            sqe->addr = (uintptr_t) addr;
+            sqe->addr2 = (uintptr_t) addrlen;
+
+            result = uring_complete(loop, coro, sqe, deadline);
+            if (result >= 0) {
+                /* make new socket non-blocking */
+                return set_nonblocking(result);
+            }
+            if (-EAGAIN == result || -EWOULDBLOCK == result) {
+                if (uring_wait(loop, coro, fd, LOOP_READ, deadline)) {
+                    return -1;
+                }
+            } else if (-EINTR != result) {
+                errno = -result;
+                return -1;
+            }
+        }
+    }
+#endif
+    for (;;) {
+        int result = accept(fd, addr, addrlen);
+        if (result >= 0) {
+            /* make new socket non-blocking */
+            return set_nonblocking(result);
+        }
+        if (EINTR != errno && !would_block(errno)) {
+            return -1;
+        }
+        if (EINTR != errno &&
+            wait_fd(loop, coro, fd, LOOP_READ, deadline)) {
+            return -1;
+        }
+    }
+}
+
+
+int loop_connect(loop_t *loop, coroutine_t *coro, int fd,
+    const struct sockaddr *addr, socklen_t addrlen)
+{
+    uint64_t deadline = loop_deadline(loop);
+    int error;
+    socklen_t length = sizeof(error);
+
+#ifdef HAVE_IO_URING
+    if (uring_direct(loop, coro)) {
+        struct io_uring_sqe *sqe = uring_prepare(loop, IORING_OP_CONNECT, fd);
+        if (NULL == sqe) {
+            return -1;
+        }
+        sqe->addr = (uintptr_t) addr;
+        sqe->off = addrlen;
+        error = uring_complete(loop, coro, sqe, deadline);
+        if (error >= 0) {
+            return 0;
+        }
+        errno = -error;
+    } else
+#endif
+    if (!connect(fd, addr, addrlen)) {
+        return 0;
+    }
+    if (EINPROGRESS != errno && EINTR != errno) {
+        return -1;
+    }
+
+    /* wait for connection to complete, then fetch its result */
+    if (wait_fd(loop, coro, fd, LOOP_WRITE, deadline) ||
+        getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length)) {
+        return -1;
+    }
+    if (error) {
+        errno = error;
+        return -1;
+    }
+
+    return 0;
+}
+
+
+int loop_close(loop_t *loop, coroutine_t *coro, int fd)
+{
+#ifdef HAVE_IO_URING
+    if (LOOP_BACKEND_IO_URING == loop->backend) {
+        int *files = loop->files.memory;
+        struct io_uring_sqe *sqe;
+        int result;
+
+        if (fd >= 0 && (size_t) fd < loop->files.size / sizeof(int) &&
+            files[fd] >= 0) {
+            /* unregister file (registered files hold a reference) */
+            struct io_uring_files_update update;
+            int none = -1;
+            memset(&update, 0, sizeof(update));
+            update.offset = (uint32_t) files[fd];
+            update.fds = (uintptr_t) &none;
+            if (ring_register(&(loop->ring), IORING_REGISTER_FILES_UPDATE,
+                &update, 1)) {
+                return -1;
+            }
+            files[fd] = -1;
+        }
+
+        sqe = uring_prepare(loop, IORING_OP_CLOSE, fd);
+        if (NULL == sqe) {
+            return -1;
+        }
+        result = uring_complete(loop, coro, sqe, loop_deadline(loop));
+        if (result < 0) {
+            errno = -result;
+            return -1;
+        }
+        return 0;
+    }
+#endif
+    (void) coro;
+    loop->deadline = NO_DEADLINE;
+    return close(fd);
+}
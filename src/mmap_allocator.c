@@ -13,20 +13,26 @@
 /* HAVE_* */
 #include "config.h"
 
-/* errno, ENOSYS */
+/* errno, EINVAL, ENOMEM, ENOSYS */
 #include <errno.h>
 /* size_t, NULL */
 #include <stddef.h>
-#ifndef HAVE_MREMAP
+/* uintptr_t */
+#include <stdint.h>
+/* FILE, fopen, fgets, sscanf, fclose */
+#include <stdio.h>
 /* memcpy */
-# include <string.h>
-#endif
+#include <string.h>
 
-/* mmap, munmap, PROT_*, MAP_*, mremap(optional), MREMAP_*(optional) */
+/* mmap, munmap, mprotect, madvise(optional), PROT_*, MAP_*, MADV_*(optional),
+ * mremap(optional), MREMAP_*(optional)
+ */
 #include <sys/mman.h>
 /* sysconf, _SC_PAGESIZE */
 #include <unistd.h>
 
+/* container_of */
+#include <threadless/container_of.h>
 /* ... */
 #include <threadless/mmap_allocator.h>
 
@@ -44,10 +50,119 @@
 #endif
 
 
-static void *do_mmap(size_t size)
+#ifndef HAVE_MAP_NORESERVE
+# define MAP_NORESERVE 0
+#endif
+
+#ifndef HAVE_MAP_STACK
+# define MAP_STACK 0
+#endif
+
+/** default huge page size (if it cannot be determined) */
+#define DEFAULT_HUGE_PAGE_SIZE ((size_t) 2 * 1024 * 1024)
+
+
+enum {
+    /** maximum number of cached mappings */
+    MMAP_CACHE_ENTRIES = 64,
+    /** number of cache buckets */
+    MMAP_CACHE_BUCKETS = 16,
+};
+
+
+/** cached (retained) mapping */
+typedef struct cache_entry cache_entry_t;
+struct cache_entry {
+    /** usable memory (above guard page, if any) */
+    void *memory;
+    /** rounded size of @p memory */
+    size_t size;
+    /** next entry in bucket (or free list) */
+    cache_entry_t *next;
+};
+
+
+/** retained mapping cache */
+typedef struct {
+    /** maximum number of cached bytes (0 disables cache) */
+    size_t limit;
+    /** number of cached bytes */
+    size_t bytes;
+    /** unused entries */
+    cache_entry_t *free;
+    /** cached entries by rounded size (most recently freed first) */
+    cache_entry_t *buckets[MMAP_CACHE_BUCKETS];
+    /** entry storage */
+    cache_entry_t entries[MMAP_CACHE_ENTRIES];
+} mmap_cache_t;
+
+
+/** @c mmap(3) allocator instance */
+typedef struct {
+    /** allocator interface */
+    allocator_t allocator;
+    /** memory containing this instance (if dynamically created) */
+    allocation_t allocation;
+    /** MMAP_ALLOCATOR_* flags */
+    int flags;
+    /** mapping granularity (or 0 for system page size) */
+    size_t granule;
+    /** mapping statistics */
+    mmap_allocator_stats_t stats;
+    /** retained mapping cache */
+    mmap_cache_t cache;
+} mmap_instance_t;
+
+
+static size_t get_page_size(void)
+{
+    static size_t page_size = 0;
+
+    if (!page_size) {
+        /* get page size */
+        long result = sysconf(_SC_PAGESIZE);
+        if (result > 0 && !(result & (result - 1))) {
+            page_size = (size_t) result;
+        } else {
+            /* not a power of 2 */
+            errno = ENOSYS;
+        }
+    }
+
+    return page_size;
+}
+
+
+static size_t get_huge_page_size(void)
 {
-    return mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS,
-        -1, 0);
+    static size_t huge_page_size = 0;
+
+    if (!huge_page_size) {
+        FILE *meminfo = fopen("/proc/meminfo", "r");
+        char line[128];
+        unsigned long kib;
+
+        huge_page_size = DEFAULT_HUGE_PAGE_SIZE;
+        while (NULL != meminfo && NULL != fgets(line, sizeof(line), meminfo)) {
+            if (1 == sscanf(line, "Hugepagesize: %lu kB", &kib) && kib &&
+                !(kib & (kib - 1))) {
+                huge_page_size = (size_t) kib * 1024;
+                break;
+            }
+        }
+        if (NULL != meminfo) {
+            (void) fclose(meminfo);
+        }
+    }
+
+    return huge_page_size;
+}
+
+
+static void *do_mmap(size_t size, int flags)
+{
+    return mmap(NULL, size, PROT_READ|PROT_WRITE,
+        MAP_PRIVATE|MAP_ANONYMOUS|flags, -1, 0);
 }
 
 
@@ -60,7 +175,7 @@ static void *do_mremap(void *memory, size_t old_size, size_t new_size)
     if (old_size < new_size) {
         /* slow remap: mmap + copy + munmap */
         size_t copy_size = (new_size < old_size) ? new_size : old_size;
-        new_memory = do_mmap(new_size);
+        new_memory = do_mmap(new_size, 0);
         if (MAP_FAILED != new_memory) {
             memcpy(new_memory, memory, copy_size);
             (void) munmap(memory, old_size);
@@ -75,30 +190,299 @@ static void *do_mremap(void *memory, size_t old_size, size_t new_size)
 }
 
 
+static char *do_mmap_huge_aligned(size_t size, size_t guard_size, int flags)
+{
+    /* transparent huge pages only back huge page aligned ranges:
+     * over-map, then trim excess head and tail (keeping any guard page)
+     */
+    size_t huge_page_size = get_huge_page_size();
+    size_t map_size = guard_size + size + huge_page_size - get_page_size();
+    char *base;
+    char *aligned;
+    size_t head;
+    size_t tail;
+
+    if (map_size < size) {
+        /* integer overflow */
+        errno = ENOMEM;
+        return MAP_FAILED;
+    }
+
+    base = do_mmap(map_size, flags);
+    if (MAP_FAILED == base) {
+        return MAP_FAILED;
+    }
+    aligned = (char *)(((uintptr_t) base + guard_size + huge_page_size - 1) &
+        ~(uintptr_t)(huge_page_size - 1));
+    head = (size_t)(aligned - guard_size - base);
+    tail = map_size - head - guard_size - size;
+    if (head) {
+        (void) munmap(base, head);
+    }
+    if (tail) {
+        (void) munmap(aligned + size, tail);
+    }
+
+    return aligned;
+}
+
+
+static void do_madvise_huge(mmap_instance_t *instance, void *memory,
+    size_t size)
+{
+#ifdef HAVE_MADV_HUGEPAGE
+    /* advice is only effective for whole aligned huge pages */
+    if (size >= get_huge_page_size() &&
+        !((uintptr_t) memory & (get_huge_page_size() - 1)) &&
+        !madvise(memory, size, MADV_HUGEPAGE)) {
+        instance->stats.madvise_maps++;
+        return;
+    }
+#else
+    (void) memory;
+    (void) size;
+#endif
+    instance->stats.regular_maps++;
+}
+
+
+static void *do_mmap_stack(mmap_instance_t *instance, size_t size,
+    size_t guard_size)
+{
+    char *memory;
+
+    /* reserve (but do not commit) guard page and usable memory */
+    if (instance->flags & MMAP_ALLOCATOR_HUGE_PAGES) {
+        memory = do_mmap_huge_aligned(size, guard_size,
+            MAP_NORESERVE|MAP_STACK);
+    } else {
+        memory = do_mmap(guard_size + size, MAP_NORESERVE|MAP_STACK);
+        if (MAP_FAILED != memory) {
+            memory += guard_size;
+        }
+    }
+    if (MAP_FAILED == memory) {
+        return MAP_FAILED;
+    }
+
+    /* make guard page inaccessible */
+    if (mprotect(memory - guard_size, guard_size, PROT_NONE)) {
+        (void) munmap(memory - guard_size, guard_size + size);
+        return MAP_FAILED;
+    }
+
+    if (instance->flags & MMAP_ALLOCATOR_HUGE_PAGES) {
+        do_madvise_huge(instance, memory, size);
+    } else {
+        instance->stats.regular_maps++;
+    }
+
+    return memory;
+}
+
+
+static void *do_mmap_huge(mmap_instance_t *instance, size_t size)
+{
+    void *memory;
+
+#ifdef HAVE_MAP_HUGETLB
+    /* explicit huge pages (fails if none are reserved) */
+    memory = do_mmap(size, MAP_HUGETLB);
+    if (MAP_FAILED != memory) {
+        instance->stats.hugetlb_maps++;
+        return memory;
+    }
+#endif
+
+    /* fall back to (transparent huge page eligible) regular pages */
+    memory = do_mmap_huge_aligned(size, 0, 0);
+    if (MAP_FAILED != memory) {
+        do_madvise_huge(instance, memory, size);
+    }
+
+    return memory;
+}
+
+
+static void *map_new(mmap_instance_t *instance, size_t size,
+    size_t guard_size)
+{
+    void *memory;
+
+    if (guard_size) {
+        memory = do_mmap_stack(instance, size, guard_size);
+    } else if (instance->flags & MMAP_ALLOCATOR_HUGE_PAGES) {
+        memory = do_mmap_huge(instance, size);
+    } else {
+        memory = do_mmap(size, 0);
+        if (MAP_FAILED != memory) {
+            instance->stats.regular_maps++;
+        }
+    }
+
+    return memory;
+}
+
+
+static void *map_resize(mmap_instance_t *instance, void *memory,
+    size_t old_size, size_t new_size, size_t guard_size)
+{
+    void *new_memory;
+
+    if (new_size < old_size) {
+        /* shrink via munmap */
+        (void) munmap((char *)memory + new_size, old_size - new_size);
+        return memory;
+    }
+
+    if (!guard_size && !(instance->flags & MMAP_ALLOCATOR_HUGE_PAGES)) {
+        return do_mremap(memory, old_size, new_size);
+    }
+
+#ifdef HAVE_MREMAP
+    /* attempt to grow in place (a guard page cannot move with the mapping,
+     * and huge page mappings may not be movable)
+     */
+    new_memory = mremap(memory, old_size, new_size, 0);
+    if (MAP_FAILED != new_memory) {
+        return new_memory;
+    }
+#endif
+
+    /* slow remap: mmap + copy + munmap */
+    new_memory = map_new(instance, new_size, guard_size);
+    if (MAP_FAILED != new_memory) {
+        memcpy(new_memory, memory, old_size);
+        (void) munmap((char *)memory - guard_size, guard_size + old_size);
+    }
+
+    return new_memory;
+}
+
+
+static inline size_t cache_bucket(const mmap_instance_t *instance,
+    size_t size)
+{
+    size_t granule = instance->granule ? instance->granule : get_page_size();
+    return (size / granule) % MMAP_CACHE_BUCKETS;
+}
+
+
+static void *cache_get(mmap_instance_t *instance, size_t size)
+{
+    mmap_cache_t *cache = &(instance->cache);
+    cache_entry_t **link;
+
+    if (!cache->bytes) {
+        return MAP_FAILED;
+    }
+
+    for (link = &(cache->buckets[cache_bucket(instance, size)]);
+        NULL != *link; link = &((*link)->next)) {
+        cache_entry_t *entry = *link;
+        if (entry->size == size) {
+            void *memory = entry->memory;
+            /* move entry to free list */
+            *link = entry->next;
+            entry->next = cache->free;
+            cache->free = entry;
+            cache->bytes -= size;
+            instance->stats.cache_hits++;
+            instance->stats.cached_bytes = cache->bytes;
+            return memory;
+        }
+    }
+
+    return MAP_FAILED;
+}
+
+
+static int cache_put(mmap_instance_t *instance, void *memory, size_t size)
+{
+    mmap_cache_t *cache = &(instance->cache);
+    cache_entry_t *entry = cache->free;
+    size_t bucket;
+
+    if (NULL == entry || size > cache->limit - cache->bytes ||
+        cache->bytes > cache->limit) {
+        /* cache full (or disabled) */
+        return -1;
+    }
+
+    /* return pages to the kernel (keeping the mapping) */
+#if defined(HAVE_MADV_FREE)
+    if (madvise(memory, size, MADV_FREE)) {
+# if defined(HAVE_MADV_DONTNEED)
+        (void) madvise(memory, size, MADV_DONTNEED);
+# endif
+    }
+#elif defined(HAVE_MADV_DONTNEED)
+    (void) madvise(memory, size, MADV_DONTNEED);
+#endif
+
+    cache->free = entry->next;
+    bucket = cache_bucket(instance, size);
+    entry->memory = memory;
+    entry->size = size;
+    entry->next = cache->buckets[bucket];
+    cache->buckets[bucket] = entry;
+    cache->bytes += size;
+    instance->stats.cached_bytes = cache->bytes;
+
+    return 0;
+}
+
+
+static void cache_trim(mmap_instance_t *instance, size_t limit)
+{
+    mmap_cache_t *cache = &(instance->cache);
+    size_t guard_size =
+        (instance->flags & MMAP_ALLOCATOR_STACK) ? get_page_size() : 0;
+    size_t bucket;
+
+    /* unmap entries (oldest last in each bucket) until within limit */
+    for (bucket = 0; cache->bytes > limit && bucket < MMAP_CACHE_BUCKETS;
+        ++bucket) {
+        while (cache->bytes > limit && NULL != cache->buckets[bucket]) {
+            cache_entry_t *entry = cache->buckets[bucket];
+            cache->buckets[bucket] = entry->next;
+            (void) munmap((char *) entry->memory - guard_size,
+                guard_size + entry->size);
+            cache->bytes -= entry->size;
+            entry->next = cache->free;
+            cache->free = entry;
+        }
+    }
+    instance->stats.cached_bytes = cache->bytes;
+}
+
+
 static int mmap_allocate(allocation_t *allocation, size_t size)
 {
-    static size_t page_size = 0;
-    static size_t page_mask = 0;
+    mmap_instance_t *instance = container_of(allocation->allocator,
+        mmap_instance_t, allocator);
+    size_t page_size = get_page_size();
+    size_t granule = instance->granule ? instance->granule : page_size;
+    size_t mask = granule - 1;
+    size_t guard_size =
+        (instance->flags & MMAP_ALLOCATOR_STACK) ? page_size : 0;
     void *new_memory = MAP_FAILED;
     size_t old_size = allocation->size;
     size_t new_size = size;
 
     if (!page_size) {
-        /* get page size */
-        long result = sysconf(_SC_PAGESIZE);
-        if (result > 0 && !(result & (result - 1))) {
-            page_size = (size_t) result;
-            page_mask = page_size - 1;
-        } else {
-            /* not a power of 2 */
-            errno = ENOSYS;
-            return -1;
-        }
+        return -1;
     }
 
-    /* round sizes up to multiple of page_size */
-    old_size = (old_size + page_size - 1) & ~page_mask;
-    new_size = (new_size + page_size - 1) & ~page_mask;
+    /* round sizes up to multiple of granule */
+    old_size = (old_size + mask) & ~mask;
+    new_size = (new_size + mask) & ~mask;
+
+    if (new_size < size) {
+        /* integer overflow */
+        errno = ENOMEM;
+        return -1;
+    }
 
     /* no mapping action required */
     if (old_size == new_size) {
@@ -107,14 +491,20 @@ static int mmap_allocate(allocation_t *allocation, size_t size)
     }
 
     if (0 == new_size) {
-        if (NULL != allocation->memory && 0 != old_size) {
-            (void) munmap(allocation->memory, old_size);
+        if (NULL != allocation->memory && 0 != old_size &&
+            cache_put(instance, allocation->memory, old_size)) {
+            (void) munmap((char *)allocation->memory - guard_size,
+                guard_size + old_size);
         }
         new_memory = NULL;
     } else if (0 == old_size) {
-        new_memory = do_mmap(new_size);
+        new_memory = cache_get(instance, new_size);
+        if (MAP_FAILED == new_memory) {
+            new_memory = map_new(instance, new_size, guard_size);
+        }
     } else {
-        new_memory = do_mremap(allocation->memory, old_size, new_size);
+        new_memory = map_resize(instance, allocation->memory, old_size,
+            new_size, guard_size);
     }
 
     if (MAP_FAILED == new_memory) {
@@ -130,20 +520,162 @@ static int mmap_allocate(allocation_t *allocation, size_t size)
 }
 
 
+static int mmap_allocate_aligned(allocation_t *allocation, size_t size,
+    size_t alignment)
+{
+    mmap_instance_t *instance = container_of(allocation->allocator,
+        mmap_instance_t, allocator);
+    size_t page_size = get_page_size();
+    size_t granule = instance->granule ? instance->granule : page_size;
+    size_t guard_size =
+        (instance->flags & MMAP_ALLOCATOR_STACK) ? page_size : 0;
+    size_t old_size = (NULL != allocation->memory) ? allocation->size : 0;
+    size_t new_size = (size + granule - 1) & ~(granule - 1);
+    size_t map_size = new_size + alignment;
+    char *memory;
+    char *aligned;
+    size_t head;
+    size_t tail;
+
+    if (!page_size) {
+        return -1;
+    }
+
+    if (alignment <= granule ||
+        (0 != old_size && size <= old_size &&
+            0 == ((uintptr_t) allocation->memory & (alignment - 1)))) {
+        /* mappings are granule aligned, and shrinking never moves memory */
+        return mmap_allocate(allocation, size);
+    }
+
+    if (new_size < size || map_size < new_size) {
+        /* integer overflow */
+        errno = ENOMEM;
+        return -1;
+    }
+
+    /* over-map, then trim excess head and tail */
+    memory = map_new(instance, map_size, guard_size);
+    if (MAP_FAILED == memory) {
+        return -1;
+    }
+    aligned = (char *)
+        (((uintptr_t) memory + alignment - 1) & ~(uintptr_t)(alignment - 1));
+    head = (size_t)(aligned - memory);
+    tail = map_size - head - new_size;
+    if (head) {
+        (void) munmap(memory - guard_size, head);
+        if (guard_size) {
+            /* move guard page below aligned memory */
+            (void) mprotect(aligned - guard_size, guard_size, PROT_NONE);
+        }
+    }
+    if (tail) {
+        (void) munmap(aligned + new_size, tail);
+    }
+
+    if (0 != old_size) {
+        memcpy(aligned, allocation->memory,
+            (old_size < size) ? old_size : size);
+        (void) mmap_allocate(allocation, 0);
+    }
+
+    /* update allocation */
+    allocation->memory = aligned;
+    allocation->size = size;
+
+    return 0;
+}
+
+
 static void mmap_destroy(allocator_t *allocator)
 {
-    /* ignore allocator */
-    (void) allocator;
+    mmap_instance_t *instance = container_of(allocator, mmap_instance_t,
+        allocator);
+    allocation_t allocation = instance->allocation;
+    /* release retained mappings */
+    cache_trim(instance, 0);
+    /* release dynamically created instances only */
+    if (NULL != allocation.memory) {
+        (void) mmap_allocate(&allocation, 0);
+    }
 }
 
 
-static allocator_t mmap_allocator = {
-    .allocate = mmap_allocate,
-    .destroy = mmap_destroy,
+static mmap_instance_t mmap_allocator = {
+    .allocator = {
+        .allocate = mmap_allocate,
+        .destroy = mmap_destroy,
+        .aligned = mmap_allocate_aligned,
+    },
+    .flags = 0,
 };
 
 
 allocator_t *mmap_allocator_get(void)
 {
-    return &mmap_allocator;
+    return &mmap_allocator.allocator;
+}
+
+
+allocator_t *mmap_allocator_create(int flags)
+{
+    mmap_instance_t *instance;
+    allocation_t allocation;
+
+    /* allocate instance using default instance */
+    allocation_init(&allocation, &mmap_allocator.allocator);
+    if (mmap_allocate(&allocation, sizeof(*instance))) {
+        return NULL;
+    }
+
+    instance = allocation.memory;
+    memcpy(&instance->allocator, &mmap_allocator.allocator,
+        sizeof(instance->allocator));
+    instance->allocation = allocation;
+    instance->flags = flags;
+    instance->granule = (flags & MMAP_ALLOCATOR_HUGE_PAGES) ?
+        get_huge_page_size() : 0;
+    memset(&(instance->stats), 0, sizeof(instance->stats));
+    memset(&(instance->cache), 0, sizeof(instance->cache));
+
+    return &instance->allocator;
+}
+
+
+void mmap_allocator_stats(allocator_t *allocator,
+    mmap_allocator_stats_t *stats)
+{
+    mmap_instance_t *instance = container_of(allocator, mmap_instance_t,
+        allocator);
+    *stats = instance->stats;
+}
+
+
+void mmap_allocator_cache_limit(allocator_t *allocator, size_t limit)
+{
+    mmap_instance_t *instance = container_of(allocator, mmap_instance_t,
+        allocator);
+    mmap_cache_t *cache = &(instance->cache);
+
+    if (!cache->limit && !cache->bytes) {
+        /* (re)build free list */
+        size_t i;
+        cache->free = NULL;
+        for (i = MMAP_CACHE_ENTRIES; i-- > 0;) {
+            cache->entries[i].next = cache->free;
+            cache->free = &(cache->entries[i]);
+        }
+    }
+
+    cache->limit = limit;
+    cache_trim(instance, limit);
+}
+
+
+void mmap_allocator_trim(allocator_t *allocator)
+{
+    mmap_instance_t *instance = container_of(allocator, mmap_instance_t,
+        allocator);
+    cache_trim(instance, 0);
 }
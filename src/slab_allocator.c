@@ -0,0 +1,304 @@
+/* threadless.io
+ * Copyright (c) 2016 Justin R. Cutler
+ * Licensed under the MIT License. See LICENSE file in the project root for
+ * full license information.
+ */
+/** @file
+ * size-class slab allocator implementation
+ * @author Justin R. Cutler <justin.r.cutler@gmail.com>
+ */
+
+/* errno, EINVAL, ENOMEM */
+#include <errno.h>
+/* size_t, NULL */
+#include <stddef.h>
+/* memcpy */
+#include <string.h>
+
+/* allocation_init, allocation_realloc_array, allocation_free */
+#include <threadless/allocation.h>
+/* container_of */
+#include <threadless/container_of.h>
+/* mmap_allocator_get */
+#include <threadless/mmap_allocator.h>
+/* ... */
+#include <threadless/slab_allocator.h>
+
+
+enum {
+    /** object alignment (and size class granularity) */
+    SLAB_ALIGN = 16,
+    /** minimum slab size */
+    SLAB_SIZE = 64 * 1024,
+    /** minimum number of objects per slab */
+    SLAB_MIN_OBJECTS = 8,
+    /** no size class */
+    SLAB_NO_CLASS = 0xFF,
+};
+
+
+static const size_t default_sizes[] = {
+    16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048, 3072,
+    4096,
+};
+
+
+typedef struct slab slab_t;
+struct slab {
+    /** memory containing this slab */
+    allocation_t allocation;
+    /** next slab */
+    slab_t *next;
+};
+
+
+typedef struct free_object free_object_t;
+struct free_object {
+    /** next free object */
+    free_object_t *next;
+};
+
+
+typedef struct {
+    /** object size */
+    size_t size;
+    /** freelist */
+    free_object_t *free;
+} slab_class_t;
+
+
+/** slab allocator instance */
+typedef struct {
+    /** allocator interface */
+    allocator_t allocator;
+    /** memory containing this instance */
+    allocation_t allocation;
+    /** allocator for large allocations */
+    allocator_t *backing;
+    /** all slabs */
+    slab_t *slabs;
+    /** largest size class */
+    size_t max_size;
+    /** number of size classes */
+    size_t count;
+    /** size classes */
+    slab_class_t classes[SLAB_ALLOCATOR_MAX_CLASSES];
+    /** size class index by (size + SLAB_ALIGN - 1) / SLAB_ALIGN */
+    unsigned char lookup[SLAB_ALLOCATOR_MAX_SIZE / SLAB_ALIGN + 1];
+} slab_allocator_t;
+
+
+static inline size_t align(size_t size)
+{
+    return (size + SLAB_ALIGN - 1) & ~(size_t)(SLAB_ALIGN - 1);
+}
+
+
+static inline slab_class_t *class_of(slab_allocator_t *slab, size_t size)
+{
+    if (0 == size || size > slab->max_size) {
+        return NULL;
+    }
+    return &(slab->classes[slab->lookup[(size + SLAB_ALIGN - 1) / SLAB_ALIGN]]);
+}
+
+
+static int slab_refill(slab_allocator_t *slab, slab_class_t *class)
+{
+    size_t header = align(sizeof(slab_t));
+    size_t size = SLAB_SIZE;
+    allocation_t allocation;
+    slab_t *new_slab;
+    char *object;
+    char *end;
+
+    if (size < header + SLAB_MIN_OBJECTS * class->size) {
+        size = header + SLAB_MIN_OBJECTS * class->size;
+    }
+
+    allocation_init(&allocation, mmap_allocator_get());
+    if (allocation_realloc_array(&allocation, 1, size)) {
+        return -1;
+    }
+
+    new_slab = allocation.memory;
+    new_slab->allocation = allocation;
+    new_slab->next = slab->slabs;
+    slab->slabs = new_slab;
+
+    /* carve slab into objects (in address order) */
+    end = (char *) new_slab + size - class->size;
+    for (object = end; object >= (char *) new_slab + header;
+        object -= class->size) {
+        free_object_t *free_object = (free_object_t *) object;
+        free_object->next = class->free;
+        class->free = free_object;
+    }
+
+    return 0;
+}
+
+
+static void *slab_pop(slab_allocator_t *slab, slab_class_t *class)
+{
+    free_object_t *object = class->free;
+
+    if (NULL == object) {
+        if (slab_refill(slab, class)) {
+            return NULL;
+        }
+        object = class->free;
+    }
+    class->free = object->next;
+
+    return object;
+}
+
+
+static inline void slab_push(slab_class_t *class, void *memory)
+{
+    free_object_t *object = memory;
+    object->next = class->free;
+    class->free = object;
+}
+
+
+static int slab_allocate(allocation_t *allocation, size_t size)
+{
+    slab_allocator_t *slab = container_of(allocation->allocator,
+        slab_allocator_t, allocator);
+    size_t old_size = (NULL != allocation->memory) ? allocation->size : 0;
+    slab_class_t *old_class = class_of(slab, old_size);
+    slab_class_t *new_class = class_of(slab, size);
+    allocation_t large = *allocation;
+    void *new_memory;
+
+    large.allocator = slab->backing;
+
+    if (0 == old_size && 0 == size) {
+        /* nothing to do */
+        new_memory = NULL;
+    } else if (NULL != new_class && old_class == new_class) {
+        /* same size class: resize in place */
+        new_memory = allocation->memory;
+    } else if (NULL == old_class && NULL == new_class) {
+        /* neither old nor new size fits a class: use backing allocator */
+        if (0 == old_size) {
+            large.memory = NULL;
+            large.size = 0;
+        }
+        if (allocation_realloc_array(&large, 1, size)) {
+            return -1;
+        }
+        new_memory = large.memory;
+    } else {
+        /* move between size classes (or backing allocator) */
+        if (NULL != new_class) {
+            new_memory = slab_pop(slab, new_class);
+            if (NULL == new_memory) {
+                return -1;
+            }
+        } else if (0 != size) {
+            allocation_t new_large;
+            allocation_init(&new_large, slab->backing);
+            if (allocation_realloc_array(&new_large, 1, size)) {
+                return -1;
+            }
+            new_memory = new_large.memory;
+        } else {
+            new_memory = NULL;
+        }
+
+        if (NULL != new_memory && 0 != old_size) {
+            memcpy(new_memory, allocation->memory,
+                (old_size < size) ? old_size : size);
+        }
+
+        /* release old memory */
+        if (NULL != old_class) {
+            slab_push(old_class, allocation->memory);
+        } else if (0 != old_size) {
+            allocation_free(&large);
+        }
+    }
+
+    /* update allocation */
+    allocation->memory = new_memory;
+    allocation->size = size;
+
+    return 0;
+}
+
+
+static void slab_destroy(allocator_t *allocator)
+{
+    slab_allocator_t *slab = container_of(allocator, slab_allocator_t,
+        allocator);
+    slab_t *current = slab->slabs;
+    allocation_t allocation = slab->allocation;
+
+    while (NULL != current) {
+        allocation_t slab_allocation = current->allocation;
+        current = current->next;
+        allocation_free(&slab_allocation);
+    }
+
+    allocation_free(&allocation);
+}
+
+
+allocator_t *slab_allocator_create(allocator_t *backing, const size_t *sizes,
+    size_t count)
+{
+    static const allocator_t slab_allocator = {
+        .allocate = slab_allocate,
+        .destroy = slab_destroy,
+    };
+    slab_allocator_t *slab;
+    allocation_t allocation;
+    size_t i;
+    size_t index;
+
+    if (NULL == sizes) {
+        sizes = default_sizes;
+        count = sizeof(default_sizes) / sizeof(default_sizes[0]);
+    }
+
+    /* validate size classes */
+    if (0 == count || count > SLAB_ALLOCATOR_MAX_CLASSES) {
+        errno = EINVAL;
+        return NULL;
+    }
+    for (i = 0; i < count; ++i) {
+        if (0 == sizes[i] || sizes[i] > SLAB_ALLOCATOR_MAX_SIZE ||
+            (i > 0 && align(sizes[i]) <= align(sizes[i - 1]))) {
+            errno = EINVAL;
+            return NULL;
+        }
+    }
+
+    allocation_init(&allocation, backing);
+    if (allocation_realloc_array(&allocation, 1, sizeof(*slab))) {
+        return NULL;
+    }
+
+    slab = allocation.memory;
+    memcpy(&slab->allocator, &slab_allocator, sizeof(slab->allocator));
+    slab->allocation = allocation;
+    slab->backing = backing;
+    slab->slabs = NULL;
+    slab->max_size = align(sizes[count - 1]);
+    slab->count = count;
+
+    /* build size classes and lookup table */
+    memset(slab->lookup, SLAB_NO_CLASS, sizeof(slab->lookup));
+    for (i = 0, index = 0; i < count; ++i) {
+        slab->classes[i].size = align(sizes[i]);
+        slab->classes[i].free = NULL;
+        for (; index <= slab->classes[i].size / SLAB_ALIGN; ++index) {
+            slab->lookup[index] = (unsigned char) i;
+        }
+    }
+
+    return &slab->allocator;
+}
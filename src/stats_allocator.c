@@ -0,0 +1,176 @@
+/* threadless.io
+ * Copyright (c) 2016 Justin R. Cutler
+ * Licensed under the MIT License. See LICENSE file in the project root for
+ * full license information.
+ */
+/** @file
+ * instrumented (statistics-gathering) allocator implementation
+ * @author Justin R. Cutler <justin.r.cutler@gmail.com>
+ */
+
+/* size_t, NULL */
+#include <stddef.h>
+/* memcpy, memset */
+#include <string.h>
+
+/* allocation_init, allocation_realloc_array, allocation_realloc_aligned,
+ * allocation_free
+ */
+#include <threadless/allocation.h>
+/* container_of */
+#include <threadless/container_of.h>
+/* ... */
+#include <threadless/stats_allocator.h>
+
+
+/** instrumented allocator instance */
+typedef struct {
+    /** allocator interface */
+    allocator_t allocator;
+    /** memory containing this instance */
+    allocation_t allocation;
+    /** wrapped allocator */
+    allocator_t *wrapped;
+    /** statistics */
+    allocator_stats_t stats;
+} stats_t;
+
+
+static inline size_t bucket(size_t size)
+{
+    size_t i = 0;
+    while (size >>= 1) {
+        ++i;
+    }
+    return i;
+}
+
+
+static int stats_record(allocation_t *allocation, size_t size, int error,
+    const allocation_t *wrapped)
+{
+    stats_t *instance = container_of(allocation->allocator, stats_t,
+        allocator);
+    allocator_stats_t *stats = &(instance->stats);
+    size_t old_size = (NULL != allocation->memory) ? allocation->size : 0;
+
+    if (error) {
+        stats->failures++;
+        return -1;
+    }
+
+    if (0 == size) {
+        if (0 != old_size) {
+            stats->frees++;
+            stats->live_allocations--;
+        }
+    } else {
+        if (0 == old_size) {
+            stats->allocations++;
+            stats->live_allocations++;
+        } else {
+            if (size > old_size) {
+                stats->grows++;
+            } else if (size < old_size) {
+                stats->shrinks++;
+            }
+            if (wrapped->memory == allocation->memory) {
+                stats->in_place++;
+            }
+        }
+        stats->histogram[bucket(size)]++;
+    }
+
+    stats->live_bytes = stats->live_bytes - old_size + size;
+    if (stats->live_bytes > stats->peak_bytes) {
+        stats->peak_bytes = stats->live_bytes;
+    }
+
+    /* update allocation */
+    allocation->memory = wrapped->memory;
+    allocation->size = wrapped->size;
+
+    return 0;
+}
+
+
+static int stats_allocate(allocation_t *allocation, size_t size)
+{
+    stats_t *instance = container_of(allocation->allocator, stats_t,
+        allocator);
+    allocation_t wrapped = *allocation;
+
+    /* perform wrapped allocator action */
+    wrapped.allocator = instance->wrapped;
+    return stats_record(allocation, size,
+        wrapped.allocator->allocate(&wrapped, size), &wrapped);
+}
+
+
+static int stats_allocate_aligned(allocation_t *allocation, size_t size,
+    size_t alignment)
+{
+    stats_t *instance = container_of(allocation->allocator, stats_t,
+        allocator);
+    allocation_t wrapped = *allocation;
+
+    /* perform wrapped allocator action */
+    wrapped.allocator = instance->wrapped;
+    return stats_record(allocation, size,
+        allocation_realloc_aligned(&wrapped, size, alignment), &wrapped);
+}
+
+
+static void stats_destroy(allocator_t *allocator)
+{
+    stats_t *instance = container_of(allocator, stats_t, allocator);
+    allocation_t allocation = instance->allocation;
+    allocation_free(&allocation);
+}
+
+
+allocator_t *stats_allocator_create(allocator_t *allocator)
+{
+    static const allocator_t stats_allocator = {
+        .allocate = stats_allocate,
+        .destroy = stats_destroy,
+        .aligned = stats_allocate_aligned,
+    };
+    stats_t *instance;
+    allocation_t allocation;
+
+    allocation_init(&allocation, allocator);
+    if (allocation_realloc_array(&allocation, 1, sizeof(*instance))) {
+        return NULL;
+    }
+
+    instance = allocation.memory;
+    memcpy(&instance->allocator, &stats_allocator,
+        sizeof(instance->allocator));
+    instance->allocation = allocation;
+    instance->wrapped = allocator;
+    memset(&(instance->stats), 0, sizeof(instance->stats));
+
+    return &instance->allocator;
+}
+
+
+void stats_allocator_snapshot(allocator_t *allocator, allocator_stats_t *stats)
+{
+    stats_t *instance = container_of(allocator, stats_t, allocator);
+    *stats = instance->stats;
+}
+
+
+void stats_allocator_reset(allocator_t *allocator)
+{
+    stats_t *instance = container_of(allocator, stats_t, allocator);
+    allocator_stats_t *stats = &(instance->stats);
+    size_t live_allocations = stats->live_allocations;
+    size_t live_bytes = stats->live_bytes;
+
+    memset(stats, 0, sizeof(*stats));
+    stats->live_allocations = live_allocations;
+    stats->live_bytes = live_bytes;
+    stats->peak_bytes = live_bytes;
+}
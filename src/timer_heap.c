@@ -0,0 +1,156 @@
+/* threadless.io
+ * Copyright (c) 2016 Justin R. Cutler
+ * Licensed under the MIT License. See LICENSE file in the project root for
+ * full license information.
+ */
+/** @file
+ * heap timer queue implementation
+ * @author Justin R. Cutler <justin.r.cutler@gmail.com>
+ */
+
+/* size_t, NULL */
+#include <stddef.h>
+/* uint64_t, UINT64_MAX */
+#include <stdint.h>
+/* memcpy */
+#include <string.h>
+
+/* allocation_init, allocation_realloc_array, allocation_free */
+#include <threadless/allocation.h>
+/* container_of */
+#include <threadless/container_of.h>
+/* heap_init, heap_push, heap_remove, heap_update, heap_peek, heap_fini */
+#include <threadless/heap.h>
+/* timer_queue_t, timer_event_t */
+#include <threadless/timer_queue.h>
+/* ... */
+#include <threadless/timer_heap.h>
+
+
+/** heap timer queue */
+typedef struct {
+    /** timer queue interface (must be first) */
+    timer_queue_t queue;
+    /** allocation containing this structure */
+    allocation_t allocation;
+    /** pending timers */
+    heap_t heap;
+} timer_heap_t;
+
+
+static inline timer_event_t *node_timer(const heap_node_t *node)
+{
+    return container_of(node, timer_event_t, entry.node);
+}
+
+
+static int timer_compare(const heap_node_t *a, const heap_node_t *b)
+{
+    uint64_t da = node_timer(a)->deadline;
+    uint64_t db = node_timer(b)->deadline;
+    return (da > db) - (da < db);
+}
+
+
+static int heap_add(timer_queue_t *queue, timer_event_t *timer,
+    uint64_t deadline)
+{
+    timer_heap_t *heap = container_of(queue, timer_heap_t, queue);
+
+    timer->deadline = deadline;
+    if (timer->queue == queue) {
+        /* refresh: restore heap order around new deadline */
+        heap_update(&(timer->entry.node));
+        return 0;
+    }
+    if (heap_push(&(heap->heap), &(timer->entry.node))) {
+        return -1;
+    }
+    timer->queue = queue;
+
+    return 0;
+}
+
+
+static void heap_cancel(timer_queue_t *queue, timer_event_t *timer)
+{
+    (void) queue;
+    heap_remove(&(timer->entry.node));
+    timer->queue = NULL;
+}
+
+
+static uint64_t heap_next(const timer_queue_t *queue)
+{
+    const timer_heap_t *heap = container_of(queue, const timer_heap_t, queue);
+    heap_node_t *node = heap_peek(&(heap->heap));
+    return (NULL != node) ? node_timer(node)->deadline : UINT64_MAX;
+}
+
+
+static size_t heap_expire(timer_queue_t *queue, uint64_t now)
+{
+    timer_heap_t *heap = container_of(queue, timer_heap_t, queue);
+    size_t max = heap->heap.count;
+    size_t count;
+
+    for (count = 0; count < max; ++count) {
+        heap_node_t *node = heap_peek(&(heap->heap));
+        timer_event_t *timer;
+
+        if (NULL == node) {
+            break;
+        }
+        timer = node_timer(node);
+        if (timer->deadline > now) {
+            break;
+        }
+
+        heap_remove(node);
+        timer->queue = NULL;
+        timer->function(timer);
+    }
+
+    return count;
+}
+
+
+static void heap_destroy(timer_queue_t *queue)
+{
+    timer_heap_t *heap = container_of(queue, timer_heap_t, queue);
+    allocation_t allocation = heap->allocation;
+    heap_node_t **storage = heap->heap.allocation.memory;
+    size_t i;
+
+    for (i = 0; i < heap->heap.count; ++i) {
+        node_timer(storage[i])->queue = NULL;
+    }
+    heap_fini(&(heap->heap));
+    allocation_free(&allocation);
+}
+
+
+timer_queue_t *timer_heap_create(allocator_t *allocator)
+{
+    static const timer_queue_t timer_heap = {
+        .add = heap_add,
+        .cancel = heap_cancel,
+        .next = heap_next,
+        .expire = heap_expire,
+        .destroy = heap_destroy,
+    };
+    timer_heap_t *heap;
+    allocation_t allocation;
+
+    allocation_init(&allocation, allocator);
+    if (allocation_realloc_array(&allocation, 1, sizeof(*heap))) {
+        return NULL;
+    }
+
+    heap = allocation.memory;
+    memcpy(&heap->queue, &timer_heap, sizeof(heap->queue));
+    heap->allocation = allocation;
+    heap_init(&(heap->heap), allocator, timer_compare);
+
+    return &heap->queue;
+}
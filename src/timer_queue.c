@@ -0,0 +1,28 @@
+/* threadless.io
+ * Copyright (c) 2016 Justin R. Cutler
+ * Licensed under the MIT License. See LICENSE file in the project root for
+ * full license information.
+ */
+/** @file
+ * timer queue implementation
+ * @author Justin R. Cutler <justin.r.cutler@gmail.com>
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+/* uint64_t */
+#include <stdint.h>
+
+/* clock_gettime, CLOCK_MONOTONIC, struct timespec */
+#include <time.h>
+
+/* ... */
+#include <threadless/timer_queue.h>
+
+
+uint64_t timer_now(void)
+{
+    struct timespec now;
+    (void) clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000u + (uint64_t) now.tv_nsec;
+}
@@ -0,0 +1,333 @@
+/* threadless.io
+ * Copyright (c) 2016 Justin R. Cutler
+ * Licensed under the MIT License. See LICENSE file in the project root for
+ * full license information.
+ */
+/** @file
+ * hierarchical timing wheel timer queue implementation
+ * @author Justin R. Cutler <justin.r.cutler@gmail.com>
+ *
+ * Level @c l holds timers whose tick first differs from the current tick in
+ * digit @c l (base @c WHEEL_SLOTS), in the slot for that digit. Advancing
+ * the current tick to the start of an occupied slot redistributes its timers
+ * to finer levels (or to the due list), so each timer cascades at most once
+ * per level. Occupancy bitmaps let idle periods be skipped in one step.
+ */
+
+/* size_t, NULL */
+#include <stddef.h>
+/* uint64_t, UINT64_MAX */
+#include <stdint.h>
+/* memcpy, memset */
+#include <string.h>
+
+/* allocation_init, allocation_realloc_array, allocation_free */
+#include <threadless/allocation.h>
+/* container_of */
+#include <threadless/container_of.h>
+/* timer_queue_t, timer_event_t */
+#include <threadless/timer_queue.h>
+/* ... */
+#include <threadless/timer_wheel.h>
+
+
+enum {
+    /** number of bits per wheel level */
+    WHEEL_BITS = 6,
+    /** number of slots per wheel level (one bitmap word) */
+    WHEEL_SLOTS = 1 << WHEEL_BITS,
+    /** number of wheel levels (covering all 64-bit ticks) */
+    WHEEL_LEVELS = (64 + WHEEL_BITS - 1) / WHEEL_BITS,
+    /** default tick length (nanoseconds) */
+    WHEEL_RESOLUTION = 1000000,
+};
+
+
+/** hierarchical timing wheel */
+typedef struct {
+    /** timer queue interface (must be first) */
+    timer_queue_t queue;
+    /** allocation containing this structure */
+    allocation_t allocation;
+    /** tick length (nanoseconds) */
+    uint64_t resolution;
+    /** current tick (timers due at or before it are on the due list) */
+    uint64_t current;
+    /** number of pending timers */
+    size_t count;
+    /** timers due for expiry (in tick order) */
+    timer_event_t *due;
+    /** last @c next link of due list */
+    timer_event_t **due_tail;
+    /** per-level slot occupancy bitmaps (cleared lazily) */
+    uint64_t occupied[WHEEL_LEVELS];
+    /** per-level slot timer lists */
+    timer_event_t *slots[WHEEL_LEVELS][WHEEL_SLOTS];
+} timer_wheel_t;
+
+
+static unsigned lowest_bit(uint64_t bits)
+{
+    /* de Bruijn sequence lookup of isolated lowest set bit */
+    static const unsigned char index[64] = {
+        0, 1, 48, 2, 57, 49, 28, 3, 61, 58, 50, 42, 38, 29, 17, 4,
+        62, 55, 59, 36, 53, 51, 43, 22, 45, 39, 33, 30, 24, 18, 12, 5,
+        63, 47, 56, 27, 60, 41, 37, 16, 54, 35, 52, 21, 44, 32, 23, 11,
+        46, 26, 40, 15, 34, 20, 31, 10, 25, 14, 19, 9, 13, 8, 7, 6,
+    };
+    return index[((bits & (0 - bits)) * 0x03F79D71B4CB0A89ULL) >> 58];
+}
+
+
+static inline uint64_t timer_tick(const timer_wheel_t *wheel,
+    uint64_t deadline)
+{
+    /* round up, so timers never expire early */
+    return deadline / wheel->resolution +
+        (0 != deadline % wheel->resolution);
+}
+
+
+static inline void link_timer(timer_event_t **head, timer_event_t *timer)
+{
+    timer_event_t *next = *head;
+
+    timer->entry.link.next = next;
+    timer->entry.link.prev = head;
+    if (NULL != next) {
+        next->entry.link.prev = &(timer->entry.link.next);
+    }
+    *head = timer;
+}
+
+
+static inline void unlink_timer(timer_wheel_t *wheel, timer_event_t *timer)
+{
+    timer_event_t *next = timer->entry.link.next;
+    timer_event_t **prev = timer->entry.link.prev;
+
+    if (wheel->due_tail == &(timer->entry.link.next)) {
+        wheel->due_tail = prev;
+    }
+    *prev = next;
+    if (NULL != next) {
+        next->entry.link.prev = prev;
+    }
+}
+
+
+static void place(timer_wheel_t *wheel, timer_event_t *timer)
+{
+    uint64_t tick = timer_tick(wheel, timer->deadline);
+    uint64_t diff;
+    unsigned level = 0;
+    unsigned slot;
+
+    if (tick <= wheel->current) {
+        /* already due: append to due list */
+        link_timer(wheel->due_tail, timer);
+        wheel->due_tail = &(timer->entry.link.next);
+        return;
+    }
+
+    /* level of most significant digit that differs from current tick */
+    diff = tick ^ wheel->current;
+    while (level < WHEEL_LEVELS - 1 &&
+        0 != (diff >> ((level + 1) * WHEEL_BITS))) {
+        ++level;
+    }
+    slot = (unsigned)(tick >> (level * WHEEL_BITS)) & (WHEEL_SLOTS - 1);
+
+    link_timer(&(wheel->slots[level][slot]), timer);
+    wheel->occupied[level] |= (uint64_t) 1 << slot;
+}
+
+
+static int find_slot(const timer_wheel_t *wheel, uint64_t *occupied,
+    unsigned *level, unsigned *slot, uint64_t *start)
+{
+    unsigned l;
+
+    for (l = 0; l < WHEEL_LEVELS; ++l) {
+        unsigned shift = l * WHEEL_BITS;
+        unsigned digit = (unsigned)(wheel->current >> shift) &
+            (WHEEL_SLOTS - 1);
+        /* slots after current digit (earlier ones belong to a later lap) */
+        uint64_t bits = occupied[l] & ~(((uint64_t) 2 << digit) - 1);
+
+        for (; 0 != bits; bits &= bits - 1) {
+            unsigned s = lowest_bit(bits);
+            if (NULL != wheel->slots[l][s]) {
+                /* start of slot: current tick's higher digits, then s */
+                uint64_t prefix = (shift + WHEEL_BITS < 64) ?
+                    wheel->current >> (shift + WHEEL_BITS) <<
+                        (shift + WHEEL_BITS) : 0;
+                *level = l;
+                *slot = s;
+                *start = prefix | (uint64_t) s << shift;
+                return 0;
+            }
+            /* emptied by cancellation (or refresh) */
+            occupied[l] &= ~((uint64_t) 1 << s);
+        }
+    }
+
+    return -1;
+}
+
+
+static void advance(timer_wheel_t *wheel, uint64_t target)
+{
+    unsigned level;
+    unsigned slot;
+    uint64_t start;
+
+    while (!find_slot(wheel, wheel->occupied, &level, &slot, &start) &&
+        start <= target) {
+        timer_event_t *timer = wheel->slots[level][slot];
+
+        /* cascade: redistribute slot relative to its start */
+        wheel->slots[level][slot] = NULL;
+        wheel->occupied[level] &= ~((uint64_t) 1 << slot);
+        wheel->current = start;
+        while (NULL != timer) {
+            timer_event_t *next = timer->entry.link.next;
+            place(wheel, timer);
+            timer = next;
+        }
+    }
+
+    /* no occupied slot starts at or before target */
+    wheel->current = target;
+}
+
+
+static int wheel_add(timer_queue_t *queue, timer_event_t *timer,
+    uint64_t deadline)
+{
+    timer_wheel_t *wheel = container_of(queue, timer_wheel_t, queue);
+
+    if (timer->queue == queue) {
+        /* refresh */
+        unlink_timer(wheel, timer);
+    } else {
+        timer->queue = queue;
+        wheel->count++;
+    }
+    timer->deadline = deadline;
+    place(wheel, timer);
+
+    return 0;
+}
+
+
+static void wheel_cancel(timer_queue_t *queue, timer_event_t *timer)
+{
+    timer_wheel_t *wheel = container_of(queue, timer_wheel_t, queue);
+
+    /* slot occupancy bit is cleared once found empty (see find_slot()) */
+    unlink_timer(wheel, timer);
+    timer->queue = NULL;
+    wheel->count--;
+}
+
+
+static uint64_t wheel_next(const timer_queue_t *queue)
+{
+    const timer_wheel_t *wheel =
+        container_of(queue, const timer_wheel_t, queue);
+    uint64_t occupied[WHEEL_LEVELS];
+    unsigned level;
+    unsigned slot;
+    uint64_t start;
+
+    if (NULL != wheel->due) {
+        return wheel->current * wheel->resolution;
+    }
+    memcpy(occupied, wheel->occupied, sizeof(occupied));
+    if (find_slot(wheel, occupied, &level, &slot, &start)) {
+        return UINT64_MAX;
+    }
+
+    /* earliest time that expiry can make progress */
+    return (start < (UINT64_MAX - 1) / wheel->resolution) ?
+        start * wheel->resolution : UINT64_MAX - 1;
+}
+
+
+static size_t wheel_expire(timer_queue_t *queue, uint64_t now)
+{
+    timer_wheel_t *wheel = container_of(queue, timer_wheel_t, queue);
+    uint64_t target = now / wheel->resolution;
+    size_t max = wheel->count;
+    size_t count;
+
+    if (target > wheel->current) {
+        advance(wheel, target);
+    }
+
+    for (count = 0; count < max && NULL != wheel->due; ++count) {
+        timer_event_t *timer = wheel->due;
+        unlink_timer(wheel, timer);
+        timer->queue = NULL;
+        wheel->count--;
+        timer->function(timer);
+    }
+
+    return count;
+}
+
+
+static void release(timer_event_t *timer)
+{
+    while (NULL != timer) {
+        timer->queue = NULL;
+        timer = timer->entry.link.next;
+    }
+}
+
+
+static void wheel_destroy(timer_queue_t *queue)
+{
+    timer_wheel_t *wheel = container_of(queue, timer_wheel_t, queue);
+    allocation_t allocation = wheel->allocation;
+    unsigned level;
+    unsigned slot;
+
+    release(wheel->due);
+    for (level = 0; level < WHEEL_LEVELS; ++level) {
+        for (slot = 0; slot < WHEEL_SLOTS; ++slot) {
+            release(wheel->slots[level][slot]);
+        }
+    }
+    allocation_free(&allocation);
+}
+
+
+timer_queue_t *timer_wheel_create(allocator_t *allocator, uint64_t resolution)
+{
+    static const timer_queue_t timer_wheel = {
+        .add = wheel_add,
+        .cancel = wheel_cancel,
+        .next = wheel_next,
+        .expire = wheel_expire,
+        .destroy = wheel_destroy,
+    };
+    timer_wheel_t *wheel;
+    allocation_t allocation;
+
+    allocation_init(&allocation, allocator);
+    if (allocation_realloc_array(&allocation, 1, sizeof(*wheel))) {
+        return NULL;
+    }
+
+    /* no pending timers: empty slots, clear bitmaps, tick 0 */
+    wheel = allocation.memory;
+    memset(wheel, 0, sizeof(*wheel));
+    memcpy(&wheel->queue, &timer_wheel, sizeof(wheel->queue));
+    wheel->allocation = allocation;
+    wheel->resolution = resolution ? resolution : WHEEL_RESOLUTION;
+    wheel->due_tail = &(wheel->due);
+
+    return &wheel->queue;
+}
@@ -8,21 +8,42 @@
  * @author Justin R. Cutler <justin.r.cutler@gmail.com>
  */
 
+/* mincore (in sys/mman.h) */
+#define _DEFAULT_SOURCE
+
 /* HAVE_* */
 #include "config.h"
 
 /* errno, EINVAL */
 #include <errno.h>
-/* printf, perror */
+/* printf, perror, fopen, fgets, fscanf, sscanf, fclose */
 #include <stdio.h>
+/* uintptr_t */
+#include <stdint.h>
 /* EXIT_SUCCESS, EXIT_FAILURE */
 #include <stdlib.h>
+/* memset, strncmp */
+#include <string.h>
+#ifdef HAVE_MMAP
+/* mincore */
+# include <sys/mman.h>
+/* sysconf, _SC_PAGESIZE */
+# include <unistd.h>
+#endif
 
+/* arena_allocator_create, arena_allocator_reset */
+#include <threadless/arena_allocator.h>
 /* default_allocator_get */
 #include <threadless/default_allocator.h>
+/* stats_allocator_create, stats_allocator_snapshot, stats_allocator_reset */
+#include <threadless/stats_allocator.h>
 #ifdef HAVE_MMAP
-/* mmap_allocator_get */
+/* mmap_allocator_get, mmap_allocator_create, mmap_allocator_stats,
+ * mmap_allocator_cache_limit, mmap_allocator_trim, MMAP_ALLOCATOR_*
+ */
 # include <threadless/mmap_allocator.h>
+/* slab_allocator_create */
+# include <threadless/slab_allocator.h>
 #endif
 /* ... */
 #include <threadless/allocation.h>
@@ -40,6 +61,351 @@ static int test_allocation(allocation_t *allocation, size_t size)
 }
 
 
+static int test_aligned(allocation_t *allocation, size_t size,
+    size_t alignment)
+{
+    int error = allocation_realloc_aligned(allocation, size, alignment);
+    if (!error && (allocation->size != size ||
+        ((uintptr_t) allocation->memory & (alignment - 1)))) {
+        /* bad size or alignment */
+        errno = EINVAL;
+        error = -1;
+    }
+    return error;
+}
+
+
+static int run_aligned(allocator_t *allocator)
+{
+    int error = 0;
+    allocation_t allocation;
+    size_t alignment;
+
+    allocation_init(&allocation, allocator);
+
+    /* alignment must be a power of 2 */
+    if (!allocation_realloc_aligned(&allocation, 64, 48) || EINVAL != errno) {
+        errno = EINVAL;
+        error = -1;
+    }
+
+    for (alignment = 1; !error && alignment <= (1 << 21); alignment <<= 3) {
+        /* allocate, grow and shrink, preserving contents */
+        error = test_aligned(&allocation, 100, alignment);
+        if (!error) {
+            memset(allocation.memory, 0x5A, 100);
+            error = test_aligned(&allocation, 10000, alignment);
+        }
+        if (!error && ((unsigned char *) allocation.memory)[99] != 0x5A) {
+            errno = EINVAL;
+            error = -1;
+        }
+        if (!error) {
+            error = test_aligned(&allocation, 50, alignment);
+        }
+        if (!error && ((unsigned char *) allocation.memory)[49] != 0x5A) {
+            errno = EINVAL;
+            error = -1;
+        }
+        /* aligned memory may be resized and freed without alignment */
+        if (!error) {
+            error = test_allocation(&allocation, 200);
+        }
+        allocation_free(&allocation);
+    }
+
+    if (error) {
+        perror("allocation_realloc_aligned");
+    }
+
+    return error;
+}
+
+
+static int run_arena(allocator_t *allocator)
+{
+    int error;
+    allocation_t a;
+    allocation_t b;
+    void *memory;
+
+    allocation_init(&a, allocator);
+    allocation_init(&b, allocator);
+
+    error = test_allocation(&a, 100);
+    if (!error) {
+        error = test_allocation(&b, 100);
+    }
+    memory = b.memory;
+
+    /* most recent allocation grows and is freed in place */
+    if (!error) {
+        error = test_allocation(&b, 200);
+    }
+    if (!error && b.memory != memory) {
+        errno = EINVAL;
+        error = -1;
+    }
+    allocation_free(&b);
+    if (!error) {
+        error = test_allocation(&b, 300);
+    }
+    if (!error && b.memory != memory) {
+        errno = EINVAL;
+        error = -1;
+    }
+
+    /* reset reuses chunk */
+    arena_allocator_reset(allocator);
+    allocation_init(&a, allocator);
+    if (!error) {
+        error = test_allocation(&a, 1);
+    }
+    if (!error && a.memory >= memory) {
+        errno = EINVAL;
+        error = -1;
+    }
+
+    if (error) {
+        perror("arena allocator");
+    }
+
+    return error;
+}
+
+
+static int run_stats(allocator_t *allocator)
+{
+    allocator_stats_t stats;
+
+    /* run() grows from 1 byte to 4 MiB, then shrinks back to 1 byte */
+    stats_allocator_snapshot(allocator, &stats);
+    if (stats.allocations != 1 || stats.grows != 22 || stats.shrinks != 22 ||
+        stats.frees != 1 || stats.failures != 0 ||
+        stats.live_allocations != 0 || stats.live_bytes != 0 ||
+        stats.peak_bytes != (1 << 22) || stats.histogram[22] != 1 ||
+        stats.histogram[0] != 2) {
+        fprintf(stderr, "stats allocator: unexpected statistics\n");
+        return -1;
+    }
+
+    stats_allocator_reset(allocator);
+    stats_allocator_snapshot(allocator, &stats);
+    if (stats.allocations != 0 || stats.peak_bytes != 0) {
+        fprintf(stderr, "stats allocator: reset failed\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+
+#ifdef HAVE_MMAP
+static int run_mmap_cache(allocator_t *allocator)
+{
+    int error;
+    allocation_t allocation;
+    mmap_allocator_stats_t stats;
+    void *memory;
+
+    allocation_init(&allocation, allocator);
+
+    /* freed mapping is retained and reused for the same size */
+    error = test_allocation(&allocation, 100000);
+    memory = allocation.memory;
+    allocation_free(&allocation);
+    if (!error) {
+        error = test_allocation(&allocation, 100000);
+    }
+    mmap_allocator_stats(allocator, &stats);
+    if (!error && (allocation.memory != memory || stats.cache_hits < 1)) {
+        fprintf(stderr, "mmap allocator: retained mapping not reused\n");
+        error = -1;
+    }
+    allocation_free(&allocation);
+
+    /* trim releases all retained mappings */
+    mmap_allocator_trim(allocator);
+    mmap_allocator_stats(allocator, &stats);
+    if (!error && stats.cached_bytes) {
+        fprintf(stderr, "mmap allocator: trim failed\n");
+        error = -1;
+    }
+
+    return error;
+}
+
+
+enum {
+    /** number of pages in stack mapping test */
+    STACK_PAGES = 64,
+};
+
+
+static int page_protection(const void *address, char perms[5])
+{
+    FILE *maps = fopen("/proc/self/maps", "r");
+    unsigned long start;
+    unsigned long end;
+    int error = -1;
+
+    if (NULL == maps) {
+        return error;
+    }
+    while (3 == fscanf(maps, "%lx-%lx %4s%*[^\n]", &start, &end, perms)) {
+        if ((uintptr_t) address >= start && (uintptr_t) address < end) {
+            error = 0;
+            break;
+        }
+    }
+    fclose(maps);
+
+    return error;
+}
+
+
+static size_t resident_pages(void *memory, size_t pages, size_t page_size)
+{
+    unsigned char vec[STACK_PAGES];
+    size_t count = 0;
+    size_t i;
+
+    if (mincore(memory, pages * page_size, vec)) {
+        return (size_t) -1;
+    }
+    for (i = 0; i < pages; ++i) {
+        count += vec[i] & 1;
+    }
+
+    return count;
+}
+
+
+static int run_mmap_stack(allocator_t *allocator)
+{
+    size_t page_size = (size_t) sysconf(_SC_PAGESIZE);
+    allocation_t allocation;
+    char perms[5];
+    char *memory;
+    int error;
+
+    allocation_init(&allocation, allocator);
+    error = test_allocation(&allocation, STACK_PAGES * page_size);
+    if (error) {
+        perror("mmap stack allocator");
+        return error;
+    }
+    memory = allocation.memory;
+
+    /* inaccessible guard page directly below, accessible memory above */
+    if (page_protection(memory - page_size, perms) ||
+        0 != strncmp(perms, "---", 3)) {
+        fprintf(stderr, "mmap stack allocator: no guard page\n");
+        error = -1;
+    } else if (page_protection(memory, perms) ||
+        0 != strncmp(perms, "rw", 2)) {
+        fprintf(stderr, "mmap stack allocator: memory not accessible\n");
+        error = -1;
+    }
+
+    /* reserved: pages are committed only once touched (stack grows down) */
+    if (!error && 0 != resident_pages(memory, STACK_PAGES, page_size)) {
+        fprintf(stderr, "mmap stack allocator: memory committed early\n");
+        error = -1;
+    }
+    if (!error) {
+        memory[(STACK_PAGES - 1) * page_size] = 1;
+        memory[(STACK_PAGES - 2) * page_size] = 1;
+        if (2 != resident_pages(memory, STACK_PAGES, page_size)) {
+            fprintf(stderr, "mmap stack allocator: unexpected commit\n");
+            error = -1;
+        }
+    }
+
+    allocation_free(&allocation);
+
+    return error;
+}
+
+
+static int run_mmap_huge(allocator_t *allocator)
+{
+    FILE *meminfo = fopen("/proc/meminfo", "r");
+    unsigned long huge_page_size = 2048;
+    char line[128];
+    allocation_t allocation;
+    mmap_allocator_stats_t before;
+    mmap_allocator_stats_t after;
+    int error;
+
+    while (NULL != meminfo && NULL != fgets(line, sizeof(line), meminfo) &&
+        1 != sscanf(line, "Hugepagesize: %lu kB", &huge_page_size)) {
+    }
+    if (NULL != meminfo) {
+        fclose(meminfo);
+    }
+    huge_page_size *= 1024;
+
+    /* huge pages (explicit or transparent) need aligned memory */
+    mmap_allocator_stats(allocator, &before);
+    allocation_init(&allocation, allocator);
+    error = test_allocation(&allocation, huge_page_size + 1);
+    mmap_allocator_stats(allocator, &after);
+    if (!error && after.regular_maps == before.regular_maps &&
+        ((uintptr_t) allocation.memory & (huge_page_size - 1))) {
+        fprintf(stderr, "mmap huge page allocator: unaligned mapping\n");
+        error = -1;
+    }
+    allocation_free(&allocation);
+
+    return error;
+}
+
+
+static int run_slab(allocator_t *allocator)
+{
+    int error;
+    allocation_t allocations[64];
+    void *memory;
+    size_t i;
+
+    /* allocate, free and reallocate many objects of one class */
+    for (i = 0; i < 64; ++i) {
+        allocation_init(&(allocations[i]), allocator);
+    }
+    for (error = 0, i = 0; !error && i < 64; ++i) {
+        error = test_allocation(&(allocations[i]), 40);
+    }
+    for (i = 0; i < 64; i += 2) {
+        allocation_free(&(allocations[i]));
+    }
+    for (i = 0; !error && i < 64; i += 2) {
+        error = test_allocation(&(allocations[i]), 33);
+    }
+
+    /* resize within a size class does not move memory */
+    memory = allocations[0].memory;
+    if (!error) {
+        error = test_allocation(&(allocations[0]), 48);
+    }
+    if (!error && allocations[0].memory != memory) {
+        errno = EINVAL;
+        error = -1;
+    }
+
+    for (i = 0; i < 64; ++i) {
+        allocation_free(&(allocations[i]));
+    }
+
+    if (error) {
+        perror("slab allocator");
+    }
+
+    return error;
+}
+#endif
+
+
 static int run(allocator_t *allocator)
 {
     int error = 0;
@@ -91,15 +457,133 @@ int main(int argc, char *argv[])
     printf("default allocator:\n");
     allocator = default_allocator_get();
     error = run(allocator);
+    if (!error) {
+        error = run_aligned(allocator);
+    }
     allocator_destroy(allocator);
 
+    if (!error) {
+        printf("arena allocator:\n");
+        allocator = arena_allocator_create(default_allocator_get(), 0);
+        if (NULL != allocator) {
+            error = run(allocator);
+            if (!error) {
+                error = run_arena(allocator);
+            }
+            if (!error) {
+                error = run_aligned(allocator);
+            }
+            allocator_destroy(allocator);
+        } else {
+            perror("arena_allocator_create");
+            error = -1;
+        }
+    }
+
+    if (!error) {
+        printf("stats allocator:\n");
+        allocator = stats_allocator_create(default_allocator_get());
+        if (NULL != allocator) {
+            error = run(allocator);
+            if (!error) {
+                error = run_stats(allocator);
+            }
+            if (!error) {
+                error = run_aligned(allocator);
+            }
+            allocator_destroy(allocator);
+        } else {
+            perror("stats_allocator_create");
+            error = -1;
+        }
+    }
+
 #ifdef HAVE_MMAP
     if (!error) {
         printf("mmap allocator:\n");
         allocator = mmap_allocator_get();
         error = run(allocator);
+        if (!error) {
+            error = run_aligned(allocator);
+        }
         allocator_destroy(allocator);
     }
+
+    if (!error) {
+        printf("mmap stack allocator:\n");
+        allocator = mmap_allocator_create(MMAP_ALLOCATOR_STACK);
+        if (NULL != allocator) {
+            error = run(allocator);
+            if (!error) {
+                error = run_aligned(allocator);
+            }
+            if (!error) {
+                error = run_mmap_stack(allocator);
+            }
+            allocator_destroy(allocator);
+        } else {
+            perror("mmap_allocator_create");
+            error = -1;
+        }
+    }
+
+    if (!error) {
+        printf("mmap huge page allocator:\n");
+        allocator = mmap_allocator_create(MMAP_ALLOCATOR_HUGE_PAGES);
+        if (NULL != allocator) {
+            mmap_allocator_stats_t stats;
+            size_t maps;
+            error = run(allocator);
+            if (!error) {
+                error = run_aligned(allocator);
+            }
+            if (!error) {
+                error = run_mmap_huge(allocator);
+            }
+            mmap_allocator_stats(allocator, &stats);
+            maps = stats.hugetlb_maps + stats.madvise_maps +
+                stats.regular_maps;
+            if (!error && !maps) {
+                fprintf(stderr, "mmap_allocator_stats: no mappings\n");
+                error = -1;
+            }
+            allocator_destroy(allocator);
+        } else {
+            perror("mmap_allocator_create");
+            error = -1;
+        }
+    }
+
+    if (!error) {
+        printf("mmap caching allocator:\n");
+        allocator = mmap_allocator_create(0);
+        if (NULL != allocator) {
+            mmap_allocator_cache_limit(allocator, 1 << 20);
+            error = run(allocator);
+            if (!error) {
+                error = run_mmap_cache(allocator);
+            }
+            allocator_destroy(allocator);
+        } else {
+            perror("mmap_allocator_create");
+            error = -1;
+        }
+    }
+
+    if (!error) {
+        printf("slab allocator:\n");
+        allocator = slab_allocator_create(default_allocator_get(), NULL, 0);
+        if (NULL != allocator) {
+            error = run(allocator);
+            if (!error) {
+                error = run_slab(allocator);
+            }
+            allocator_destroy(allocator);
+        } else {
+            perror("slab_allocator_create");
+            error = -1;
+        }
+    }
 #endif
 
     return !error ? EXIT_SUCCESS : EXIT_FAILURE;
@@ -11,6 +11,8 @@
 /* HAVE_* */
 #include "config.h"
 
+/* errno, EBUSY */
+#include <errno.h>
 /* printf, perror */
 #include <stdio.h>
 /* EXIT_SUCCESS, EXIT_FAILURE */
@@ -18,10 +20,12 @@
 
 /* allocator_t, allocator_destroy */
 #include <threadless/allocation.h>
+/* arena_allocator_create */
+#include <threadless/arena_allocator.h>
 /* default_allocator_get */
 #include <threadless/default_allocator.h>
 #ifdef HAVE_MMAP
-/* mmap_allocator_get */
+/* mmap_allocator_get, mmap_allocator_create, MMAP_ALLOCATOR_STACK */
 # include <threadless/mmap_allocator.h>
 #endif
 /* ... */
@@ -58,14 +62,36 @@ static void deferred_puts(void *data)
 }
 
 
+static char *deferred_messages[] = {
+    "deferred output 0", "deferred output 1", "deferred output 2",
+    "deferred output 3", "deferred output 4", "deferred output 5",
+    "deferred output 6", "deferred output 7", "deferred output 8",
+};
+static const size_t deferred_count =
+    sizeof(deferred_messages) / sizeof(deferred_messages[0]);
+
+
 static void *output_coroutine(coroutine_t *coro, void *data)
 {
     size_t *value = data;
+    size_t i;
 
-    if (coroutine_defer(coro, deferred_puts, "deferred output 0")) {
-        return NULL;
+    for (i = 0; i < deferred_count; ++i) {
+        if (coroutine_defer(coro, deferred_puts, deferred_messages[i])) {
+            return NULL;
+        }
+        if (coroutine_defer(coro, deferred_puts, "cancelled")) {
+            return NULL;
+        }
+    }
+
+    /* cancel every other registration (in mixed order) */
+    for (i = 0; i < deferred_count; ++i) {
+        if (coroutine_defer_cancel(coro, deferred_puts, "cancelled")) {
+            return NULL;
+        }
     }
-    if (coroutine_defer(coro, deferred_puts, "deferred output 1")) {
+    if (!coroutine_defer_cancel(coro, deferred_puts, "cancelled")) {
         return NULL;
     }
 
@@ -78,6 +104,534 @@ static void *output_coroutine(coroutine_t *coro, void *data)
 }
 
 
+static void run_coroutines(coroutine_t *fibonacci, coroutine_t *output)
+{
+    while (!(coroutine_ended(fibonacci) || coroutine_ended(output))) {
+        void *data;
+        data = coroutine_resume(fibonacci, NULL);
+        data = coroutine_resume(output, data);
+    }
+}
+
+
+static int run_pool(allocator_t *allocator)
+{
+    int error = -1;
+    coroutine_pool_t *pool;
+    coroutine_t *fibonacci = NULL;
+    coroutine_t *output = NULL;
+    coroutine_t *previous = NULL;
+    int i;
+
+    pool = coroutine_pool_create(allocator, 4096, 2);
+    if (NULL == pool) {
+        perror("coroutine_pool_create");
+        return error;
+    }
+
+    for (i = 0; i < 2; ++i) {
+        fibonacci = coroutine_pool_acquire(pool, fibonacci_generator);
+        if (NULL == fibonacci) {
+            perror("coroutine_pool_acquire");
+            goto fail;
+        }
+
+        if (NULL != previous && previous != fibonacci) {
+            fprintf(stderr, "coroutine_pool_acquire: coroutine not reused\n");
+            goto fail;
+        }
+
+        output = coroutine_pool_acquire(pool, output_coroutine);
+        if (NULL == output) {
+            perror("coroutine_pool_acquire");
+            goto fail;
+        }
+
+        run_coroutines(fibonacci, output);
+
+        coroutine_pool_release(output);
+        output = NULL;
+        /* released last, so acquired first */
+        coroutine_pool_release(fibonacci);
+        previous = fibonacci;
+        fibonacci = NULL;
+    }
+
+    error = 0;
+
+fail:
+    coroutine_pool_release(output);
+    coroutine_pool_release(fibonacci);
+    coroutine_pool_destroy(pool);
+
+    return error;
+}
+
+
+enum {
+    /** number of scheduled coroutines */
+    TASKS = 4,
+    /** number of times each scheduled coroutine runs */
+    TASK_STEPS = 3,
+};
+
+
+static int task_order[TASKS * TASK_STEPS];
+static size_t task_steps;
+
+
+static void *task(coroutine_t *coro, void *data)
+{
+    int index = *(int *) data;
+    int i;
+
+    for (i = 0; i < TASK_STEPS; ++i) {
+        task_order[task_steps++] = index;
+        if (i + 1 < TASK_STEPS) {
+            /* let the other ready coroutines run first */
+            coroutine_ready(coro, NULL);
+            (void) coroutine_yield(coro, NULL);
+        }
+    }
+
+    return NULL;
+}
+
+
+static int run_scheduler(allocator_t *allocator)
+{
+    static int indices[TASKS];
+    scheduler_t *scheduler = scheduler_create(allocator);
+    int error = 0;
+    size_t i;
+
+    if (NULL == scheduler) {
+        perror("scheduler_create");
+        return -1;
+    }
+
+    task_steps = 0;
+    for (i = 0; !error && i < TASKS; ++i) {
+        coroutine_t *coro = coroutine_create(allocator, task, 4096);
+        if (NULL == coro) {
+            perror("coroutine_create");
+            error = -1;
+            break;
+        }
+        indices[i] = (int) i;
+        coroutine_spawn(scheduler, coro, &indices[i]);
+    }
+
+    /* bounded first tick, then run to completion */
+    if (!error && (scheduler_run(scheduler, 2) != 2 ||
+        scheduler_ready_count(scheduler) != TASKS ||
+        scheduler_run(scheduler, 0) != TASKS * TASK_STEPS - 2 ||
+        scheduler_count(scheduler) != 0)) {
+        fprintf(stderr, "scheduler_run: unexpected resume count\n");
+        error = -1;
+    }
+
+    /* round-robin order */
+    for (i = 0; !error && i < TASKS * TASK_STEPS; ++i) {
+        if (task_order[i] != (int)(i % TASKS)) {
+            fprintf(stderr, "scheduler_run: unexpected order\n");
+            error = -1;
+        }
+    }
+
+    scheduler_destroy(scheduler);
+
+    return error;
+}
+
+
+enum {
+    /** number of values passed between transferring coroutines */
+    TRANSFERS = 100,
+};
+
+
+static coroutine_t *producer_coro;
+
+
+static void *producer(coroutine_t *coro, void *data)
+{
+    coroutine_t *consumer = data;
+    int i;
+
+    /* hand each value directly to consumer (which hands control back) */
+    for (i = 1; i <= TRANSFERS; ++i) {
+        (void) coroutine_transfer(coro, consumer, &i);
+    }
+    (void) coroutine_transfer(coro, consumer, NULL);
+
+    return coro;
+}
+
+
+static void *consumer(coroutine_t *coro, void *data)
+{
+    static int sum;
+
+    for (sum = 0; NULL != data;
+        data = coroutine_transfer(coro, producer_coro, NULL)) {
+        sum += *(int *) data;
+    }
+
+    /* final value goes to producer's resumer */
+    return &sum;
+}
+
+
+static int run_transfer(allocator_t *allocator)
+{
+    int error = -1;
+    coroutine_t *consumer_coro;
+    int *sum;
+
+    producer_coro = coroutine_create(allocator, producer, 4096);
+    consumer_coro = coroutine_create(allocator, consumer, 4096);
+    if (NULL == producer_coro || NULL == consumer_coro) {
+        perror("coroutine_create");
+        goto fail;
+    }
+
+    sum = coroutine_resume(producer_coro, consumer_coro);
+    if (NULL == sum || *sum != TRANSFERS * (TRANSFERS + 1) / 2 ||
+        !coroutine_ended(consumer_coro) || coroutine_ended(producer_coro)) {
+        fprintf(stderr, "coroutine_transfer: unexpected result\n");
+        goto fail;
+    }
+    if (coroutine_resume(producer_coro, NULL) != producer_coro ||
+        !coroutine_ended(producer_coro)) {
+        fprintf(stderr, "coroutine_transfer: producer did not end\n");
+        goto fail;
+    }
+
+    error = 0;
+
+fail:
+    coroutine_destroy(consumer_coro);
+    coroutine_destroy(producer_coro);
+
+    return error;
+}
+
+
+enum {
+    /** number of coroutines sharing a stack */
+    SHARED_COROUTINES = 16,
+    /** number of round-robin resumes of each shared stack coroutine */
+    SHARED_ROUNDS = 8,
+    /** size of shared stack */
+    SHARED_STACK_SIZE = 65536,
+};
+
+
+static int shared_frame(coroutine_t *coro, unsigned depth, unsigned seed)
+{
+    unsigned char buffer[256];
+    size_t i;
+    int error = 0;
+
+    for (i = 0; i < sizeof(buffer); ++i) {
+        buffer[i] = (unsigned char)(seed + depth + i);
+    }
+    if (depth > 0) {
+        error = shared_frame(coro, depth - 1, seed);
+    } else {
+        int round;
+        /* other coroutines overwrite the shared stack while suspended */
+        for (round = 0; round < SHARED_ROUNDS; ++round) {
+            (void) coroutine_yield(coro, &error);
+        }
+    }
+    for (i = 0; i < sizeof(buffer); ++i) {
+        error = error || buffer[i] != (unsigned char)(seed + depth + i);
+    }
+
+    return error;
+}
+
+
+static void *shared_coroutine(coroutine_t *coro, void *data)
+{
+    static int result;
+    unsigned seed = *(unsigned *) data;
+
+    /* vary stack depth (and so saved size) per coroutine */
+    result = shared_frame(coro, seed % 8, seed);
+
+    return &result;
+}
+
+
+static void *busy_coroutine(coroutine_t *coro, void *data)
+{
+    static int busy;
+
+    /* sibling on the same stack cannot run while this one does */
+    busy = NULL == coroutine_resume(data, NULL) && EBUSY == errno;
+
+    (void) coro;
+    return &busy;
+}
+
+
+static int run_shared(allocator_t *allocator)
+{
+    int error = -1;
+    coroutine_stack_t *stack;
+    coroutine_t *coros[SHARED_COROUTINES] = { NULL };
+    unsigned seeds[SHARED_COROUTINES];
+    int *result;
+    int round;
+    size_t i;
+
+    stack = coroutine_stack_create(allocator, SHARED_STACK_SIZE);
+    if (NULL == stack) {
+        perror("coroutine_stack_create");
+        return error;
+    }
+    for (i = 0; i < SHARED_COROUTINES; ++i) {
+        coros[i] = coroutine_create_shared(allocator, shared_coroutine,
+            stack);
+        if (NULL == coros[i]) {
+            perror("coroutine_create_shared");
+            goto fail;
+        }
+        seeds[i] = (unsigned) i * 37;
+    }
+
+    /* initial resume, then yields, then final return of each coroutine */
+    for (round = 0; round <= SHARED_ROUNDS; ++round) {
+        for (i = 0; i < SHARED_COROUTINES; ++i) {
+            result = coroutine_resume(coros[i], &(seeds[i]));
+            if (NULL == result || 0 != *result) {
+                fprintf(stderr, "coroutine_create_shared: stack corrupted\n");
+                goto fail;
+            }
+        }
+    }
+    for (i = 0; i < SHARED_COROUTINES; ++i) {
+        if (!coroutine_ended(coros[i])) {
+            fprintf(stderr, "coroutine_create_shared: did not end\n");
+            goto fail;
+        }
+        coroutine_destroy(coros[i]);
+        coros[i] = NULL;
+    }
+
+    coros[0] = coroutine_create_shared(allocator, busy_coroutine, stack);
+    coros[1] = coroutine_create_shared(allocator, shared_coroutine, stack);
+    if (NULL == coros[0] || NULL == coros[1]) {
+        perror("coroutine_create_shared");
+        goto fail;
+    }
+    result = coroutine_resume(coros[0], coros[1]);
+    if (NULL == result || !*result) {
+        fprintf(stderr, "coroutine_create_shared: expected EBUSY\n");
+        goto fail;
+    }
+
+    error = 0;
+
+fail:
+    for (i = 0; i < SHARED_COROUTINES; ++i) {
+        coroutine_destroy(coros[i]);
+    }
+    coroutine_stack_destroy(stack);
+
+    return error;
+}
+
+
+enum {
+    /** stack size of painted coroutines */
+    PAINT_STACK_SIZE = 65536,
+    /** stack bytes used by painted coroutines */
+    PAINT_USAGE = 8192,
+    /** number of coroutines created with sampling enabled */
+    PAINT_SAMPLES = 8,
+};
+
+
+static void *stack_user(coroutine_t *coro, void *data)
+{
+    volatile unsigned char buffer[PAINT_USAGE];
+    size_t i;
+
+    (void) coro;
+    (void) data;
+
+    for (i = 0; i < sizeof(buffer); ++i) {
+        buffer[i] = 0;
+    }
+
+    return NULL;
+}
+
+
+static size_t histogram_total(void)
+{
+    size_t histogram[COROUTINE_STACK_HISTOGRAM_SIZE];
+    size_t total = 0;
+    size_t i;
+
+    coroutine_stack_histogram(histogram);
+    for (i = 0; i < COROUTINE_STACK_HISTOGRAM_SIZE; ++i) {
+        total += histogram[i];
+    }
+
+    return total;
+}
+
+
+static int run_stack_paint(allocator_t *allocator)
+{
+    int error = 0;
+    coroutine_t *coro;
+    size_t high_water;
+    size_t i;
+
+    coroutine_stack_histogram_reset();
+
+    coro = coroutine_create(allocator, stack_user, PAINT_STACK_SIZE);
+    if (NULL == coro) {
+        perror("coroutine_create");
+        return -1;
+    }
+    error = 0 != coroutine_stack_high_water(coro);
+    coroutine_stack_paint(coro);
+    (void) coroutine_resume(coro, NULL);
+    high_water = coroutine_stack_high_water(coro);
+    error = error || high_water < PAINT_USAGE ||
+        high_water >= PAINT_STACK_SIZE;
+    coroutine_destroy(coro);
+    error = error || histogram_total() != 1;
+
+    /* paint every other coroutine */
+    coroutine_stack_paint_sample(2);
+    for (i = 0; !error && i < PAINT_SAMPLES; ++i) {
+        coro = coroutine_create(allocator, stack_user, PAINT_STACK_SIZE);
+        if (NULL == coro) {
+            perror("coroutine_create");
+            error = -1;
+            break;
+        }
+        (void) coroutine_resume(coro, NULL);
+        coroutine_destroy(coro);
+    }
+    coroutine_stack_paint_sample(0);
+    error = error || histogram_total() != 1 + PAINT_SAMPLES / 2;
+
+    if (error) {
+        fprintf(stderr, "coroutine_stack_high_water: unexpected result\n");
+    }
+
+    return error;
+}
+
+
+/** hook call counts */
+typedef struct {
+    unsigned create;
+    unsigned resume;
+    unsigned yield;
+    unsigned end;
+    unsigned destroy;
+} hook_counts_t;
+
+
+static void count_create(coroutine_t *coro, void *data)
+{
+    (void) coro;
+    ((hook_counts_t *) data)->create++;
+}
+
+
+static void count_resume(coroutine_t *coro, void *data)
+{
+    (void) coro;
+    ((hook_counts_t *) data)->resume++;
+}
+
+
+static void count_yield(coroutine_t *coro, void *data)
+{
+    (void) coro;
+    ((hook_counts_t *) data)->yield++;
+}
+
+
+static void count_end(coroutine_t *coro, void *data)
+{
+    (void) coro;
+    ((hook_counts_t *) data)->end++;
+}
+
+
+static void count_destroy(coroutine_t *coro, void *data)
+{
+    (void) coro;
+    ((hook_counts_t *) data)->destroy++;
+}
+
+
+static int run_hooks(allocator_t *allocator)
+{
+    hook_counts_t counts = { 0, 0, 0, 0, 0 };
+    coroutine_hooks_t hooks = {
+        .create = count_create,
+        .resume = count_resume,
+        .yield = count_yield,
+        .end = count_end,
+        .destroy = count_destroy,
+    };
+    int error = 0;
+    coroutine_t *coro;
+    int i;
+
+    hooks.data = &counts;
+    coroutine_hooks_set(&hooks);
+    coro = coroutine_create(allocator, fibonacci_generator, 4096);
+    if (NULL == coro) {
+        coroutine_hooks_set(NULL);
+        perror("coroutine_create");
+        return -1;
+    }
+    for (i = 0; i < 10; ++i) {
+        (void) coroutine_resume(coro, NULL);
+    }
+    error = coroutine_switches(coro) != 10;
+    coroutine_hooks_set(NULL);
+
+    /* not counted while disabled */
+    (void) coroutine_resume(coro, NULL);
+    error = error || coroutine_switches(coro) != 10;
+    coroutine_destroy(coro);
+
+    error = error || counts.create != 1 || counts.resume != 10 ||
+        counts.yield != 10 || counts.end != 0 || counts.destroy != 0;
+
+    /* transfer: one yield (from) and one resume (to) per value */
+    coroutine_hooks_set(&hooks);
+    counts.resume = 0;
+    counts.yield = 0;
+    error = error || run_transfer(allocator);
+    coroutine_hooks_set(NULL);
+    error = error || counts.create != 3 || counts.destroy != 2 ||
+        counts.end != 2 || counts.resume != counts.yield ||
+        counts.resume != 3 + 2 * TRANSFERS;
+
+    if (error) {
+        fprintf(stderr, "coroutine_hooks_set: unexpected counts\n");
+    }
+
+    return error;
+}
+
+
 static int run(allocator_t *allocator)
 {
     int error = -1;
@@ -96,13 +650,29 @@ static int run(allocator_t *allocator)
         goto fail;
     }
 
-    while (!(coroutine_ended(fibonacci) || coroutine_ended(output))) {
-        void *data;
-        data = coroutine_resume(fibonacci, NULL);
-        data = coroutine_resume(output, data);
-    }
+    run_coroutines(fibonacci, output);
 
-    error = 0;
+    coroutine_destroy(output);
+    output = NULL;
+    coroutine_destroy(fibonacci);
+    fibonacci = NULL;
+
+    error = run_pool(allocator);
+    if (!error) {
+        error = run_scheduler(allocator);
+    }
+    if (!error) {
+        error = run_transfer(allocator);
+    }
+    if (!error) {
+        error = run_shared(allocator);
+    }
+    if (!error) {
+        error = run_stack_paint(allocator);
+    }
+    if (!error) {
+        error = run_hooks(allocator);
+    }
 
 fail:
     coroutine_destroy(output);
@@ -125,6 +695,18 @@ int main(int argc, char *argv[])
     error = run(allocator);
     allocator_destroy(allocator);
 
+    if (!error) {
+        printf("arena allocator:\n");
+        allocator = arena_allocator_create(default_allocator_get(), 0);
+        if (NULL != allocator) {
+            error = run(allocator);
+            allocator_destroy(allocator);
+        } else {
+            perror("arena_allocator_create");
+            error = -1;
+        }
+    }
+
 #ifdef HAVE_MMAP
     if (!error) {
         printf("mmap allocator:\n");
@@ -132,6 +714,18 @@ int main(int argc, char *argv[])
         error = run(allocator);
         allocator_destroy(allocator);
     }
+
+    if (!error) {
+        printf("mmap stack allocator:\n");
+        allocator = mmap_allocator_create(MMAP_ALLOCATOR_STACK);
+        if (NULL != allocator) {
+            error = run(allocator);
+            allocator_destroy(allocator);
+        } else {
+            perror("mmap_allocator_create");
+            error = -1;
+        }
+    }
 #endif
 
     return !error ? EXIT_SUCCESS : EXIT_FAILURE;
@@ -0,0 +1,134 @@
+/* threadless.io
+ * Copyright (c) 2016 Justin R. Cutler
+ * Licensed under the MIT License. See LICENSE file in the project root for
+ * full license information.
+ */
+/** @file
+ * coroutine trace exporter test
+ * @author Justin R. Cutler <justin.r.cutler@gmail.com>
+ */
+
+/* printf, perror, fprintf, tmpfile, rewind, fread, fclose, FILE */
+#include <stdio.h>
+/* EXIT_SUCCESS, EXIT_FAILURE */
+#include <stdlib.h>
+/* strstr, strncmp */
+#include <string.h>
+
+/* allocator_t, allocator_destroy */
+#include <threadless/allocation.h>
+/* coroutine_create, coroutine_resume, coroutine_yield, coroutine_destroy */
+#include <threadless/coroutine.h>
+/* default_allocator_get */
+#include <threadless/default_allocator.h>
+/* ... */
+#include <threadless/coroutine_trace.h>
+
+
+enum {
+    /** number of traced yields */
+    YIELDS = 4,
+    /** maximum trace size */
+    TRACE_SIZE = 16384,
+};
+
+
+static void *yielder(coroutine_t *coro, void *data)
+{
+    int i;
+
+    for (i = 0; i < YIELDS; ++i) {
+        (void) coroutine_yield(coro, data);
+    }
+
+    return NULL;
+}
+
+
+static size_t count(const char *haystack, const char *needle)
+{
+    size_t n = 0;
+
+    for (haystack = strstr(haystack, needle); NULL != haystack;
+        haystack = strstr(haystack + 1, needle)) {
+        ++n;
+    }
+
+    return n;
+}
+
+
+static int run(allocator_t *allocator, FILE *file)
+{
+    static char buffer[TRACE_SIZE];
+    coroutine_trace_t *trace;
+    coroutine_t *coro;
+    size_t size;
+    int error = 0;
+    int i;
+
+    trace = coroutine_trace_start(allocator, file);
+    if (NULL == trace) {
+        perror("coroutine_trace_start");
+        return -1;
+    }
+    coro = coroutine_create(allocator, yielder, 4096);
+    if (NULL == coro) {
+        perror("coroutine_create");
+        (void) coroutine_trace_stop(trace);
+        return -1;
+    }
+    /* YIELDS yields, then end */
+    for (i = 0; i <= YIELDS; ++i) {
+        (void) coroutine_resume(coro, NULL);
+    }
+    coroutine_destroy(coro);
+    if (coroutine_trace_stop(trace)) {
+        perror("coroutine_trace_stop");
+        return -1;
+    }
+
+    rewind(file);
+    size = fread(buffer, 1, sizeof(buffer) - 1, file);
+    buffer[size] = '\0';
+
+    /* a complete JSON array, with one slice per resume */
+    error = '[' != buffer[0] || size < 3 ||
+        0 != strncmp(buffer + size - 3, "\n]\n", 3);
+    error = error || count(buffer, "\"ph\":\"B\"") != YIELDS + 1 ||
+        count(buffer, "\"ph\":\"E\"") != YIELDS + 1;
+    error = error || count(buffer, "\"name\":\"thread_name\"") != 1 ||
+        count(buffer, "\"name\":\"create\"") != 1 ||
+        count(buffer, "\"name\":\"end\"") != 1 ||
+        count(buffer, "\"name\":\"destroy\"") != 1;
+    if (error) {
+        fprintf(stderr, "unexpected trace:\n%s", buffer);
+    }
+
+    return error;
+}
+
+
+int main(int argc, char *argv[])
+{
+    allocator_t *allocator = default_allocator_get();
+    FILE *file = tmpfile();
+    int error;
+
+    (void) argc;
+    (void) argv;
+
+    if (NULL == file) {
+        perror("tmpfile");
+        return EXIT_FAILURE;
+    }
+
+    printf("Chrome trace export:\n");
+    error = run(allocator, file);
+    printf("%s\n", !error ? "OK" : "FAILED");
+
+    fclose(file);
+    allocator_destroy(allocator);
+
+    return !error ? EXIT_SUCCESS : EXIT_FAILURE;
+}
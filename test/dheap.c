@@ -0,0 +1,166 @@
+/* threadless.io
+ * Copyright (c) 2016 Justin R. Cutler
+ * Licensed under the MIT License. See LICENSE file in the project root for
+ * full license information.
+ */
+/** @file
+ * d-ary keyed heap interface test
+ * @author Justin R. Cutler <justin.r.cutler@gmail.com>
+ */
+
+/* HAVE_* */
+#include "config.h"
+
+/* errno, EINVAL */
+#include <errno.h>
+/* printf, perror */
+#include <stdio.h>
+/* EXIT_SUCCESS, EXIT_FAILURE */
+#include <stdlib.h>
+
+/* default_allocator_get */
+#include <threadless/default_allocator.h>
+#ifdef HAVE_MMAP
+/* mmap_allocator_get */
+# include <threadless/mmap_allocator.h>
+#endif
+/* ... */
+#include <threadless/dheap.h>
+
+
+const int data[] = {
+    4 /* duplicate (remove) */,
+    6 /* duplicate (update to 1) */,
+    9, 2, 8, 4, 0, 5, 3, 6, 7,
+    99 /* remove */,
+    -1 /* update to 10 */,
+};
+const size_t data_count = sizeof(data) / sizeof(data[0]);
+
+
+static int run_many(allocator_t *allocator, size_t count)
+{
+    int error;
+    allocation_t alloc;
+    dheap_node_t *nodes;
+    dheap_t heap;
+    size_t i;
+    dheap_node_t *node;
+    uint64_t previous = 0;
+
+    allocation_init(&alloc, allocator);
+    error = allocation_realloc_array(&alloc, count, sizeof(*nodes));
+    if (error) {
+        return error;
+    }
+    nodes = alloc.memory;
+
+    dheap_init(&heap, allocator);
+
+    /* push pseudo-random keys into heap */
+    for (i = 0; !error && i < count; ++i) {
+        error = dheap_push(&heap, &(nodes[i]), (i * 7919) % count);
+    }
+
+    /* move every third node */
+    for (i = 0; !error && i < count; i += 3) {
+        dheap_update(&(nodes[i]), (i * 104729) % count);
+    }
+
+    /* pull keys out of heap (checking order) */
+    while (!error && NULL != (node = dheap_peek(&heap))) {
+        uint64_t key = dheap_key(node);
+        if (key < previous || node != dheap_pop(&heap) || NULL != node->heap) {
+            errno = EINVAL;
+            error = -1;
+        }
+        previous = key;
+    }
+
+    if (error) {
+        perror("dheap");
+    }
+
+    dheap_fini(&heap);
+
+    allocation_free(&alloc);
+
+    return error;
+}
+
+
+static int run(allocator_t *allocator)
+{
+    int error = 0;
+    allocation_t alloc;
+    dheap_node_t *nodes = NULL;
+    dheap_t heap;
+    size_t i;
+    dheap_node_t *node;
+
+    allocation_init(&alloc, allocator);
+    error = allocation_realloc_array(&alloc, data_count, sizeof(*nodes));
+    if (error) {
+        return error;
+    }
+    nodes = alloc.memory;
+
+    dheap_init(&heap, allocator);
+
+    /* push keys into heap */
+    for (i = 0; !error && i < data_count; ++i) {
+        error = dheap_push(&heap, &(nodes[i]), (uint64_t) data[i]);
+    }
+
+    /* remove from middle */
+    dheap_remove(&(nodes[0]));
+
+    /* remove from end */
+    dheap_remove(&(nodes[data_count - 2]));
+
+    /* update */
+    dheap_update(&(nodes[1]), 1);
+    dheap_update(&(nodes[data_count - 1]), 10);
+
+    /* pull keys out of heap (lowest first) */
+    while (NULL != (node = dheap_peek(&heap))) {
+        printf("%i\n", (int) dheap_key(node));
+        (void) dheap_pop(&heap);
+    }
+
+    dheap_fini(&heap);
+
+    allocation_free(&alloc);
+
+    if (!error) {
+        error = run_many(allocator, 10007);
+    }
+
+    return error;
+}
+
+
+int main(int argc, char *argv[])
+{
+    int error;
+    allocator_t *allocator;
+
+    (void) argc;
+    (void) argv;
+
+    printf("default allocator:\n");
+    allocator = default_allocator_get();
+    error = run(allocator);
+    allocator_destroy(allocator);
+
+#ifdef HAVE_MMAP
+    if (!error) {
+        printf("mmap allocator:\n");
+        allocator = mmap_allocator_get();
+        error = run(allocator);
+        allocator_destroy(allocator);
+    }
+#endif
+
+    return !error ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -26,6 +26,8 @@
 /* mmap_allocator_get */
 # include <threadless/mmap_allocator.h>
 #endif
+/* THREADLESS_HEAP_DEFINE */
+#include <threadless/heap_define.h>
 /* ... */
 #include <threadless/heap.h>
 
@@ -53,6 +55,226 @@ static int min_compare(const heap_node_t *a, const heap_node_t *b)
 }
 
 
+#define value_compare(a, b) ((a)->value - (b)->value)
+THREADLESS_HEAP_DEFINE(value_heap, value_t, node, value_compare)
+
+
+static int run_typed(allocator_t *allocator)
+{
+    int error = 0;
+    allocation_t alloc;
+    value_t *values = NULL;
+    heap_t heap;
+    size_t i;
+    value_t *value;
+
+    allocation_init(&alloc, allocator);
+    error = allocation_realloc_array(&alloc, data_count + 1, sizeof(*values));
+    if (error) {
+        return error;
+    }
+    values = alloc.memory;
+
+    value_heap_init(&heap, allocator);
+
+    /* push values into heap */
+    for (i = 0; !error && i < data_count; ++i) {
+        values[i].value = data[i];
+        error = value_heap_push(&heap, &(values[i]));
+    }
+
+    /* remove from middle */
+    value_heap_remove(&(values[0]));
+
+    /* remove from end (generic API) */
+    heap_remove(&(values[data_count - 1].node));
+
+    /* replace */
+    values[data_count].value = 1;
+    value_heap_replace(&(values[1]), &(values[data_count]));
+
+    /* update */
+    values[2].value = -values[2].value;
+    value_heap_update(&(values[2]));
+    values[2].value = -values[2].value;
+    value_heap_update(&(values[2]));
+
+    /* pull values out of heap (minimum first) */
+    while (NULL != (value = value_heap_pop(&heap))) {
+        printf("%i\n", value->value);
+    }
+
+    heap_fini(&heap);
+
+    allocation_free(&alloc);
+
+    return error;
+}
+
+
+static int run_many(allocator_t *allocator, size_t count)
+{
+    int error;
+    allocation_t alloc;
+    value_t *values;
+    heap_t heap;
+    size_t i;
+    size_t capacity;
+    heap_node_t *node;
+    int previous = -1;
+
+    allocation_init(&alloc, allocator);
+    error = allocation_realloc_array(&alloc, count, sizeof(*values));
+    if (error) {
+        return error;
+    }
+    values = alloc.memory;
+
+    heap_init(&heap, allocator, min_compare);
+
+    /* push pseudo-random values into heap */
+    for (i = 0; !error && i < count; ++i) {
+        values[i].value = (int)((i * 7919) % count);
+        error = heap_push(&heap, &(values[i].node));
+    }
+    capacity = heap.capacity;
+
+    /* change keys in place */
+    for (i = 0; i < count; i += 3) {
+        int old = values[i].value;
+        values[i].value = (int)((i * 104729) % count);
+        if (values[i].value < old) {
+            heap_decrease_key(&(values[i].node));
+        } else {
+            heap_increase_key(&(values[i].node));
+        }
+    }
+    for (i = 1; i < count; i += 3) {
+        values[i].value = (int)((i * 15485863) % count);
+        heap_update(&(values[i].node));
+    }
+
+    /* remove arbitrary values (the last value may move either way) */
+    for (i = 2; i < count; i += 5) {
+        heap_remove(&(values[i].node));
+    }
+
+    /* pull values out of heap (checking order) */
+    while (!error && NULL != (node = heap_pop(&heap))) {
+        value_t *value = container_of(node, value_t, node);
+        if (value->value < previous || heap.count > heap.capacity) {
+            errno = EINVAL;
+            error = -1;
+        }
+        previous = value->value;
+    }
+
+    /* storage must have grown geometrically and shrunk lazily */
+    if (!error && (capacity < count || capacity >= 2 * count ||
+        heap.capacity >= capacity)) {
+        errno = EINVAL;
+        error = -1;
+    }
+
+    /* reserve */
+    if (!error) {
+        error = heap_reserve(&heap, count);
+    }
+    if (!error && heap.capacity < count) {
+        errno = EINVAL;
+        error = -1;
+    }
+
+    if (error) {
+        perror("heap");
+    }
+
+    heap_fini(&heap);
+
+    allocation_free(&alloc);
+
+    return error;
+}
+
+
+static int run_bulk(allocator_t *allocator, size_t count)
+{
+    int error;
+    allocation_t alloc;
+    allocation_t alloc_nodes;
+    value_t *values;
+    heap_node_t **nodes;
+    heap_t heap;
+    size_t i;
+    value_t threshold;
+    int previous = -1;
+
+    allocation_init(&alloc, allocator);
+    allocation_init(&alloc_nodes, allocator);
+    error = allocation_realloc_array(&alloc, count, sizeof(*values));
+    if (!error) {
+        error = allocation_realloc_array(&alloc_nodes, count, sizeof(*nodes));
+    }
+    if (error) {
+        allocation_free(&alloc);
+        return error;
+    }
+    values = alloc.memory;
+    nodes = alloc_nodes.memory;
+
+    for (i = 0; i < count; ++i) {
+        values[i].value = (int)((i * 7919) % count);
+        nodes[i] = &(values[i].node);
+    }
+
+    /* build from first half, then push a large and a small batch */
+    error = heap_init_from_array(&heap, allocator, min_compare, nodes,
+        count / 2);
+    if (!error) {
+        error = heap_push_many(&heap, nodes + count / 2, count / 2 - 10);
+    }
+    if (!error) {
+        error = heap_push_many(&heap, nodes + count - 10, 10);
+    }
+
+    /* pull values out of heap in bounded batches (checking order) */
+    threshold.value = 0;
+    while (!error && heap.count) {
+        heap_node_t *batch[64];
+        size_t n;
+        threshold.value += 100;
+        do {
+            n = heap_pop_until(&heap, &(threshold.node), batch, 64);
+            for (i = 0; i < n; ++i) {
+                value_t *value = container_of(batch[i], value_t, node);
+                if (value->value < previous ||
+                    value->value > threshold.value) {
+                    errno = EINVAL;
+                    error = -1;
+                }
+                previous = value->value;
+            }
+        } while (n == 64);
+    }
+
+    if (!error && previous != (int) count - 1) {
+        errno = EINVAL;
+        error = -1;
+    }
+
+    if (error) {
+        perror("heap_push_many");
+    }
+
+    heap_fini(&heap);
+
+    allocation_free(&alloc_nodes);
+    allocation_free(&alloc);
+
+    return error;
+}
+
+
 static int run(allocator_t *allocator)
 {
     int error = 0;
@@ -97,6 +319,18 @@ static int run(allocator_t *allocator)
 
     allocation_free(&alloc);
 
+    if (!error) {
+        error = run_typed(allocator);
+    }
+
+    if (!error) {
+        error = run_many(allocator, 10007);
+    }
+
+    if (!error) {
+        error = run_bulk(allocator, 10008);
+    }
+
     return error;
 }
 
@@ -0,0 +1,657 @@
+/* threadless.io
+ * Copyright (c) 2016 Justin R. Cutler
+ * Licensed under the MIT License. See LICENSE file in the project root for
+ * full license information.
+ */
+/** @file
+ * event loop interface test
+ * @author Justin R. Cutler <justin.r.cutler@gmail.com>
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+/* errno, ETIMEDOUT */
+#include <errno.h>
+/* LONG_MAX */
+#include <limits.h>
+/* printf, perror, fprintf */
+#include <stdio.h>
+/* EXIT_SUCCESS, EXIT_FAILURE */
+#include <stdlib.h>
+/* memcmp, memcpy, memset */
+#include <string.h>
+
+/* htonl, INADDR_LOOPBACK */
+#include <arpa/inet.h>
+/* fcntl, F_GETFL, F_SETFL, O_NONBLOCK */
+#include <fcntl.h>
+/* struct sockaddr_in */
+#include <netinet/in.h>
+/* socket, socketpair, bind, listen, getsockname, AF_*, SOCK_* */
+#include <sys/socket.h>
+/* struct iovec */
+#include <sys/uio.h>
+/* close */
+#include <unistd.h>
+
+/* allocator_t */
+#include <threadless/allocation.h>
+/* coroutine_create, coroutine_create_shared, coroutine_stack_* */
+#include <threadless/coroutine.h>
+/* default_allocator_get */
+#include <threadless/default_allocator.h>
+/* ... */
+#include <threadless/loop.h>
+/* timer_heap_create */
+#include <threadless/timer_heap.h>
+/* timer_now */
+#include <threadless/timer_queue.h>
+/* timer_wheel_create */
+#include <threadless/timer_wheel.h>
+
+
+enum {
+    /** coroutine stack size */
+    STACK_SIZE = 64 * 1024,
+    /** number of concurrent echo connections */
+    CONNECTIONS = 200,
+    /** number of messages per echo connection */
+    MESSAGES = 10,
+    /** size of bulk transfer */
+    BULK_SIZE = 4 * 1024 * 1024,
+    /** number of sleeping coroutines */
+    SLEEPERS = 5,
+    /** number of echo connections on a shared stack */
+    SHARED_CONNECTIONS = 20,
+    /** nanoseconds per millisecond */
+    NS_PER_MS = 1000000,
+};
+
+
+/** test connection state */
+typedef struct {
+    /** event loop */
+    loop_t *loop;
+    /** file descriptor */
+    int fd;
+    /** result */
+    int error;
+    /** listening socket address (accept/connect test only) */
+    struct sockaddr_in address;
+} connection_t;
+
+
+static loop_t *loop;
+static coroutine_stack_t *shared_stack;
+static connection_t servers[CONNECTIONS];
+static connection_t clients[CONNECTIONS];
+static char fixed_buffer[4096];
+static int wake_order[SLEEPERS];
+static int woken;
+
+
+static int set_nonblocking(int fd)
+{
+    int flags = fcntl(fd, F_GETFL);
+    return (flags < 0) ? -1 : fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+
+static void *echo_server(coroutine_t *coro, void *data)
+{
+    connection_t *connection = data;
+    char buffer[256];
+    ssize_t count;
+
+    /* echo until end of file */
+    while ((count = loop_read(connection->loop, coro, connection->fd, buffer,
+        sizeof(buffer))) > 0) {
+        if (loop_write(connection->loop, coro, connection->fd, buffer,
+            (size_t) count) != count) {
+            break;
+        }
+    }
+    connection->error = (0 != count);
+    (void) close(connection->fd);
+
+    return NULL;
+}
+
+
+static void *echo_client(coroutine_t *coro, void *data)
+{
+    connection_t *connection = data;
+    char message[32];
+    char buffer[32];
+    int i;
+
+    for (i = 0; !connection->error && i < MESSAGES; ++i) {
+        int length = snprintf(message, sizeof(message), "message %d", i);
+        connection->error =
+            loop_write(connection->loop, coro, connection->fd, message,
+                (size_t) length) != length ||
+            loop_read(connection->loop, coro, connection->fd, buffer,
+                sizeof(buffer)) != length ||
+            memcmp(message, buffer, (size_t) length);
+    }
+    (void) close(connection->fd);
+
+    return NULL;
+}
+
+
+static void *bulk_writer(coroutine_t *coro, void *data)
+{
+    connection_t *connection = data;
+    static char buffer[64 * 1024];
+    size_t total = 0;
+
+    memset(buffer, 0x5A, sizeof(buffer));
+    while (!connection->error && total < BULK_SIZE) {
+        size_t size = BULK_SIZE - total;
+        ssize_t count = loop_write(connection->loop, coro, connection->fd,
+            buffer, (size < sizeof(buffer)) ? size : sizeof(buffer));
+        connection->error = (count <= 0);
+        total += (count > 0) ? (size_t) count : 0;
+    }
+    (void) close(connection->fd);
+
+    return NULL;
+}
+
+
+static void *bulk_reader(coroutine_t *coro, void *data)
+{
+    connection_t *connection = data;
+    char buffer[4096];
+    size_t total = 0;
+    ssize_t count;
+
+    while ((count = loop_read(connection->loop, coro, connection->fd, buffer,
+        sizeof(buffer))) > 0) {
+        total += (size_t) count;
+    }
+    connection->error = (0 != count || BULK_SIZE != total);
+
+    return NULL;
+}
+
+
+static void *fixed_server(coroutine_t *coro, void *data)
+{
+    connection_t *connection = data;
+    char *buffer = fixed_buffer + sizeof(fixed_buffer) / 2;
+    ssize_t count = loop_read_fixed(connection->loop, coro, connection->fd,
+        buffer, sizeof(fixed_buffer) / 2, 0);
+
+    connection->error = count != 10 || memcmp(fixed_buffer, buffer, 10);
+    connection->error |= loop_close(connection->loop, coro, connection->fd);
+
+    return NULL;
+}
+
+
+static void *fixed_client(coroutine_t *coro, void *data)
+{
+    connection_t *connection = data;
+    ssize_t count;
+
+    memcpy(fixed_buffer, "registered", 10);
+    count = loop_write_fixed(connection->loop, coro, connection->fd,
+        fixed_buffer, 10, 0);
+    connection->error = count != 10;
+    connection->error |= loop_close(connection->loop, coro, connection->fd);
+
+    return NULL;
+}
+
+
+static void *acceptor(coroutine_t *coro, void *data)
+{
+    connection_t *connection = data;
+    int fd = loop_accept(connection->loop, coro, connection->fd, NULL, NULL);
+    coroutine_t *server;
+
+    if (fd < 0) {
+        connection->error = 1;
+        return NULL;
+    }
+
+    /* serve accepted connection from a new coroutine */
+    server = coroutine_create(default_allocator_get(), echo_server,
+        STACK_SIZE);
+    if (NULL == server) {
+        (void) close(fd);
+        connection->error = 1;
+        return NULL;
+    }
+    servers[0].loop = connection->loop;
+    servers[0].fd = fd;
+    servers[0].error = 0;
+    loop_spawn(connection->loop, server, &servers[0]);
+
+    return NULL;
+}
+
+
+static void *connector(coroutine_t *coro, void *data)
+{
+    connection_t *connection = data;
+
+    if (loop_connect(connection->loop, coro, connection->fd,
+        (const struct sockaddr *) &connection->address,
+        sizeof(connection->address))) {
+        connection->error = 1;
+        return NULL;
+    }
+
+    return echo_client(coro, data);
+}
+
+
+static void *sleeper(coroutine_t *coro, void *data)
+{
+    connection_t *connection = data;
+    uint64_t start = timer_now();
+    int index = (int)(connection - clients);
+    unsigned long ms = (unsigned long)(SLEEPERS - index) * 10;
+
+    /* later-spawned coroutines sleep for less time (and wake first) */
+    connection->error = loop_sleep(connection->loop, coro, ms) ||
+        timer_now() - start < ms * NS_PER_MS;
+    wake_order[woken++] = index;
+
+    return NULL;
+}
+
+
+static void *timed_reader(coroutine_t *coro, void *data)
+{
+    connection_t *connection = data;
+    uint64_t start = timer_now();
+    char buffer[16];
+
+    /* idle peer: read must time out */
+    loop_timeout(connection->loop, 20);
+    connection->error = loop_read(connection->loop, coro, connection->fd,
+        buffer, sizeof(buffer)) != -1 || ETIMEDOUT != errno ||
+        timer_now() - start < 20 * NS_PER_MS;
+
+    /* deadline consumed: next read waits for data */
+    connection->error |= loop_read(connection->loop, coro, connection->fd,
+        buffer, sizeof(buffer)) != 4;
+
+    /* data arrives before deadline */
+    loop_timeout(connection->loop, 10000);
+    connection->error |= loop_read(connection->loop, coro, connection->fd,
+        buffer, sizeof(buffer)) != 4;
+    (void) close(connection->fd);
+
+    return NULL;
+}
+
+
+static void *patient_reader(coroutine_t *coro, void *data)
+{
+    connection_t *connection = data;
+    char buffer[16];
+
+    int i;
+
+    /* far-off deadline saturates (rather than wrapping into the past) */
+    for (i = 0; i < 2; ++i) {
+        ssize_t count;
+        loop_timeout(connection->loop, LONG_MAX);
+        count = loop_read(connection->loop, coro, connection->fd, buffer,
+            sizeof(buffer));
+        if (4 != count) {
+            connection->error = 1;
+            if (-1 == count && ETIMEDOUT == errno) {
+                fprintf(stderr, "loop_timeout(LONG_MAX) timed out\n");
+            }
+            /* let the writer finish before closing */
+            (void) loop_sleep(connection->loop, coro, 100);
+            break;
+        }
+    }
+    (void) close(connection->fd);
+
+    return NULL;
+}
+
+
+static void *timed_writer(coroutine_t *coro, void *data)
+{
+    connection_t *connection = data;
+
+    connection->error = loop_sleep(connection->loop, coro, 50) ||
+        loop_write(connection->loop, coro, connection->fd, "late", 4) != 4 ||
+        loop_sleep(connection->loop, coro, 10) ||
+        loop_write(connection->loop, coro, connection->fd, "soon", 4) != 4;
+    (void) close(connection->fd);
+
+    return NULL;
+}
+
+
+static void *spinner(coroutine_t *coro, void *data)
+{
+    int i;
+
+    (void) data;
+
+    /* stay ready (without waiting) while echo traffic is served */
+    for (i = 0; i < 10000; ++i) {
+        coroutine_ready(coro, NULL);
+        (void) coroutine_yield(coro, NULL);
+    }
+
+    return NULL;
+}
+
+
+static int spawn(coroutine_function_t *function, connection_t *connection)
+{
+    coroutine_t *coro = (NULL != shared_stack) ?
+        coroutine_create_shared(default_allocator_get(), function,
+            shared_stack) :
+        coroutine_create(default_allocator_get(), function, STACK_SIZE);
+    if (NULL == coro) {
+        perror("coroutine_create");
+        return -1;
+    }
+    connection->loop = loop;
+    connection->error = 0;
+    loop_spawn(loop, coro, connection);
+    return 0;
+}
+
+
+static int run_pairs(coroutine_function_t *server,
+    coroutine_function_t *client, size_t count)
+{
+    int error = 0;
+    size_t i;
+
+    for (i = 0; !error && i < count; ++i) {
+        int fds[2];
+        error = socketpair(AF_UNIX, SOCK_STREAM, 0, fds) ||
+            set_nonblocking(fds[0]) || set_nonblocking(fds[1]);
+        if (error) {
+            perror("socketpair");
+            break;
+        }
+        servers[i].fd = fds[0];
+        clients[i].fd = fds[1];
+        error = spawn(server, &servers[i]) || spawn(client, &clients[i]);
+    }
+
+    if (!error && loop_run(loop)) {
+        perror("loop_run");
+        error = -1;
+    }
+
+    for (i = 0; !error && i < count; ++i) {
+        error = servers[i].error || clients[i].error;
+    }
+
+    return error;
+}
+
+
+static int run_accept(void)
+{
+    connection_t *listener = &clients[1];
+    connection_t *client = &clients[0];
+    socklen_t length = sizeof(listener->address);
+    int error;
+
+    /* listen on an ephemeral loopback port */
+    memset(&listener->address, 0, sizeof(listener->address));
+    listener->address.sin_family = AF_INET;
+    listener->address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    listener->fd = socket(AF_INET, SOCK_STREAM, 0);
+    client->fd = socket(AF_INET, SOCK_STREAM, 0);
+    error = listener->fd < 0 || client->fd < 0 ||
+        set_nonblocking(listener->fd) || set_nonblocking(client->fd) ||
+        bind(listener->fd, (struct sockaddr *) &listener->address, length) ||
+        listen(listener->fd, 1) ||
+        getsockname(listener->fd, (struct sockaddr *) &listener->address,
+            &length);
+    if (error) {
+        perror("socket");
+    }
+
+    client->address = listener->address;
+    if (!error) {
+        error = spawn(acceptor, listener) || spawn(connector, client);
+    }
+    if (!error && loop_run(loop)) {
+        perror("loop_run");
+        error = -1;
+    }
+    if (!error) {
+        error = listener->error || client->error || servers[0].error;
+    }
+
+    if (listener->fd >= 0) {
+        (void) close(listener->fd);
+    }
+
+    return error;
+}
+
+
+static int run_registered(void)
+{
+    struct iovec iovec;
+    int fds[2];
+    int error;
+
+    iovec.iov_base = fixed_buffer;
+    iovec.iov_len = sizeof(fixed_buffer);
+    error = socketpair(AF_UNIX, SOCK_STREAM, 0, fds) ||
+        set_nonblocking(fds[0]) || set_nonblocking(fds[1]);
+    if (error) {
+        perror("socketpair");
+        return error;
+    }
+
+    error = loop_register_buffers(loop, &iovec, 1) ||
+        loop_register_files(loop, fds, 2);
+    if (error) {
+        perror("loop_register");
+    }
+
+    servers[0].fd = fds[0];
+    clients[0].fd = fds[1];
+    if (!error) {
+        error = spawn(fixed_server, &servers[0]) ||
+            spawn(fixed_client, &clients[0]);
+    }
+    if (!error && loop_run(loop)) {
+        perror("loop_run");
+        error = -1;
+    }
+    if (!error) {
+        error = servers[0].error || clients[0].error ||
+            loop_unregister_files(loop) || loop_unregister_buffers(loop);
+    }
+
+    return error;
+}
+
+
+static int run_sleep(void)
+{
+    int error = 0;
+    int i;
+
+    woken = 0;
+    for (i = 0; !error && i < SLEEPERS; ++i) {
+        error = spawn(sleeper, &clients[i]);
+    }
+    if (!error && loop_run(loop)) {
+        perror("loop_run");
+        error = -1;
+    }
+    for (i = 0; !error && i < SLEEPERS; ++i) {
+        error = clients[i].error || wake_order[i] != SLEEPERS - 1 - i;
+    }
+
+    return error;
+}
+
+
+static int run_timer_queues(void)
+{
+    allocator_t *allocator = default_allocator_get();
+    timer_queue_t *queue;
+    int error;
+
+    /* invalid class (queue is not taken over) */
+    queue = timer_heap_create(allocator);
+    if (NULL == queue) {
+        perror("timer_heap_create");
+        return -1;
+    }
+    error = loop_timer_queue(loop, LOOP_TIMER_CLASSES, queue) != -1 ||
+        EINVAL != errno;
+    timer_queue_destroy(queue);
+
+    /* swap default stores: heap for deadlines, wheel for sleeps */
+    if (!error) {
+        queue = timer_heap_create(allocator);
+        error = NULL == queue ||
+            loop_timer_queue(loop, LOOP_TIMERS_TIMEOUT, queue);
+    }
+    if (!error) {
+        queue = timer_wheel_create(allocator, 0);
+        error = NULL == queue ||
+            loop_timer_queue(loop, LOOP_TIMERS_SLEEP, queue);
+    }
+    if (error) {
+        perror("loop_timer_queue");
+        return error;
+    }
+
+    return run_sleep() || run_pairs(timed_reader, timed_writer, 1);
+}
+
+
+static int run_shared(void)
+{
+    int error;
+
+    shared_stack = coroutine_stack_create(default_allocator_get(),
+        STACK_SIZE);
+    if (NULL == shared_stack) {
+        perror("coroutine_stack_create");
+        return -1;
+    }
+
+    /* stack buffers, waits and sleeps interleaved across one stack */
+    error = run_pairs(echo_server, echo_client, SHARED_CONNECTIONS) ||
+        run_sleep() || run_pairs(timed_reader, timed_writer, 1);
+
+    /* all coroutines have ended (and been destroyed) by loop_run() */
+    coroutine_stack_destroy(shared_stack);
+    shared_stack = NULL;
+
+    return error;
+}
+
+
+static int run(int backend)
+{
+    int error;
+
+    loop = loop_create_backend(default_allocator_get(), backend);
+    if (NULL == loop) {
+        if (LOOP_BACKEND_IO_URING == backend) {
+            /* not supported by kernel */
+            perror("loop_create_backend (skipped)");
+            return 0;
+        }
+        perror("loop_create_backend");
+        return -1;
+    }
+
+    printf("echo:\n");
+    error = run_pairs(echo_server, echo_client, CONNECTIONS);
+    printf("%s\n", !error ? "OK" : "FAILED");
+
+    if (!error) {
+        printf("bulk transfer:\n");
+        error = run_pairs(bulk_reader, bulk_writer, 1);
+        (void) close(servers[0].fd);
+        printf("%s\n", !error ? "OK" : "FAILED");
+    }
+
+    if (!error) {
+        printf("accept/connect:\n");
+        error = run_accept();
+        printf("%s\n", !error ? "OK" : "FAILED");
+    }
+
+    if (!error) {
+        printf("echo with busy coroutine:\n");
+        error = spawn(spinner, &clients[CONNECTIONS - 1]) ||
+            run_pairs(echo_server, echo_client, 1);
+        printf("%s\n", !error ? "OK" : "FAILED");
+    }
+
+    if (!error) {
+        printf("sleep:\n");
+        error = run_sleep();
+        printf("%s\n", !error ? "OK" : "FAILED");
+    }
+
+    if (!error) {
+        printf("timeouts:\n");
+        error = run_pairs(timed_reader, timed_writer, 1) ||
+            run_pairs(patient_reader, timed_writer, 1);
+        printf("%s\n", !error ? "OK" : "FAILED");
+    }
+
+    if (!error) {
+        printf("sleep and timeouts with swapped timer stores:\n");
+        error = run_timer_queues();
+        printf("%s\n", !error ? "OK" : "FAILED");
+    }
+
+    if (!error) {
+        printf("shared stack coroutines:\n");
+        error = run_shared();
+        printf("%s\n", !error ? "OK" : "FAILED");
+    }
+
+    if (!error) {
+        printf("registered buffers and files:\n");
+        error = run_registered();
+        printf("%s\n", !error ? "OK" : "FAILED");
+    }
+
+    loop_destroy(loop);
+
+    return error;
+}
+
+
+int main(int argc, char *argv[])
+{
+    int error;
+
+    (void) argc;
+    (void) argv;
+
+    printf("epoll backend:\n");
+    error = run(LOOP_BACKEND_EPOLL);
+
+    if (!error) {
+        printf("io_uring backend:\n");
+        error = run(LOOP_BACKEND_IO_URING);
+    }
+
+    return !error ? EXIT_SUCCESS : EXIT_FAILURE;
+}
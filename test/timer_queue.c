@@ -0,0 +1,256 @@
+/* threadless.io
+ * Copyright (c) 2016 Justin R. Cutler
+ * Licensed under the MIT License. See LICENSE file in the project root for
+ * full license information.
+ */
+/** @file
+ * timer queue interface test
+ * @author Justin R. Cutler <justin.r.cutler@gmail.com>
+ */
+
+/* printf */
+#include <stdio.h>
+/* EXIT_SUCCESS, EXIT_FAILURE */
+#include <stdlib.h>
+/* uint64_t, UINT64_MAX */
+#include <stdint.h>
+
+/* container_of */
+#include <threadless/container_of.h>
+/* default_allocator_get */
+#include <threadless/default_allocator.h>
+/* timer_heap_create */
+#include <threadless/timer_heap.h>
+/* timer_wheel_create */
+#include <threadless/timer_wheel.h>
+/* ... */
+#include <threadless/timer_queue.h>
+
+
+enum {
+    /** number of test timers */
+    TIMERS = 8,
+    /** number of timers in randomized comparison */
+    RANDOM_TIMERS = 1000,
+    /** number of operations in randomized comparison */
+    RANDOM_STEPS = 200000,
+};
+
+
+/** test timer */
+typedef struct {
+    timer_event_t timer;
+    int index;
+} test_timer_t;
+
+
+static timer_queue_t *queue;
+static test_timer_t timers[TIMERS];
+static timer_event_t random_timers[2][RANDOM_TIMERS];
+static int order[TIMERS];
+static size_t expired;
+
+
+static void record(timer_event_t *timer)
+{
+    order[expired++] = container_of(timer, test_timer_t, timer)->index;
+}
+
+
+static void rearm(timer_event_t *timer)
+{
+    record(timer);
+    /* re-add already-expired deadline (must not livelock) */
+    (void) timer_queue_add(queue, timer, 0);
+}
+
+
+static int run_order(void)
+{
+    /* deadlines in reverse index order */
+    static const uint64_t deadlines[TIMERS] = {80, 70, 60, 50, 40, 30, 20, 10};
+    int error = 0;
+    size_t i;
+
+    expired = 0;
+    for (i = 0; !error && i < TIMERS; ++i) {
+        timers[i].index = (int) i;
+        timer_init(&(timers[i].timer), record);
+        error = timer_queue_add(queue, &(timers[i].timer), deadlines[i]);
+    }
+    if (error) {
+        return error;
+    }
+
+    /* cancel one pending timer, and one that is not pending */
+    timer_queue_cancel(&(timers[5].timer));
+    timer_queue_cancel(&(timers[5].timer));
+
+    error = error || timer_queue_next(queue) != 10;
+    error = error || timer_queue_expire(queue, 5) != 0;
+    error = error || timer_queue_expire(queue, 50) != 4;
+    error = error || order[0] != 7 || order[1] != 6 || order[2] != 4 ||
+        order[3] != 3;
+    error = error || timer_pending(&(timers[3].timer)) ||
+        !timer_pending(&(timers[2].timer));
+    error = error || timer_queue_next(queue) != 60;
+    error = error || timer_queue_expire(queue, UINT64_MAX - 1) != 3;
+    error = error || order[4] != 2 || order[5] != 1 || order[6] != 0;
+    error = error || timer_queue_next(queue) != UINT64_MAX;
+
+    return error;
+}
+
+
+static int run_rearm(void)
+{
+    int error;
+
+    expired = 0;
+    timers[0].index = 0;
+    timer_init(&(timers[0].timer), rearm);
+    error = timer_queue_add(queue, &(timers[0].timer), 1);
+
+    /* one expiry per call, despite re-adding */
+    error = error || timer_queue_expire(queue, 1) != 1;
+    error = error || !timer_pending(&(timers[0].timer));
+    error = error || timer_queue_expire(queue, 1) != 1;
+    timer_queue_cancel(&(timers[0].timer));
+    error = error || timer_queue_next(queue) != UINT64_MAX;
+
+    return error;
+}
+
+
+static uint64_t xorshift64(uint64_t *state)
+{
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *state = x;
+}
+
+
+static void ignore(timer_event_t *timer)
+{
+    (void) timer;
+}
+
+
+static int run_random(timer_queue_t *reference)
+{
+    uint64_t state = 88172645463325252ULL;
+    uint64_t now = 0;
+    int error = 0;
+    size_t i;
+
+    /* same trace of adds, refreshes and cancellations on both queues */
+    for (i = 0; i < RANDOM_TIMERS; ++i) {
+        timer_init(&(random_timers[0][i]), ignore);
+        timer_init(&(random_timers[1][i]), ignore);
+    }
+    for (i = 0; !error && i < RANDOM_STEPS; ++i) {
+        uint64_t r = xorshift64(&state);
+        size_t index = (size_t)(r % RANDOM_TIMERS);
+        uint64_t deadline = now + ((r >> 16) % ((r & 0x100) ? 100 : 100000));
+
+        switch ((r >> 10) % 8) {
+        case 0:
+            timer_queue_cancel(&(random_timers[0][index]));
+            timer_queue_cancel(&(random_timers[1][index]));
+            break;
+        case 1:
+            /* advance time: same number of timers must expire */
+            now += (r >> 32) % 5000;
+            error = timer_queue_expire(queue, now) !=
+                timer_queue_expire(reference, now);
+            break;
+        default:
+            error = timer_queue_add(queue, &(random_timers[0][index]),
+                    deadline) ||
+                timer_queue_add(reference, &(random_timers[1][index]),
+                    deadline);
+            break;
+        }
+    }
+    for (i = 0; !error && i < RANDOM_TIMERS; ++i) {
+        error = timer_pending(&(random_timers[0][i])) !=
+            timer_pending(&(random_timers[1][i]));
+    }
+    error = error || timer_queue_expire(queue, UINT64_MAX - 1) !=
+        timer_queue_expire(reference, UINT64_MAX - 1);
+    error = error || timer_queue_next(queue) != UINT64_MAX;
+
+    return error;
+}
+
+
+static int run(void)
+{
+    int error;
+
+    printf("ordering and cancellation:\n");
+    error = run_order();
+    printf("%s\n", !error ? "OK" : "FAILED");
+
+    if (!error) {
+        printf("re-adding from expiry function:\n");
+        error = run_rearm();
+        printf("%s\n", !error ? "OK" : "FAILED");
+    }
+
+    return error;
+}
+
+
+int main(int argc, char *argv[])
+{
+    allocator_t *allocator = default_allocator_get();
+    timer_queue_t *reference;
+    uint64_t start;
+    int error;
+
+    (void) argc;
+    (void) argv;
+
+    printf("heap:\n");
+    queue = timer_heap_create(allocator);
+    error = (NULL == queue) || run();
+    if (NULL != queue) {
+        timer_queue_destroy(queue);
+    }
+
+    if (!error) {
+        /* 1ns ticks (exact) */
+        printf("wheel:\n");
+        queue = timer_wheel_create(allocator, 1);
+        error = (NULL == queue) || run();
+        if (NULL != queue) {
+            timer_queue_destroy(queue);
+        }
+    }
+
+    if (!error) {
+        printf("wheel vs. heap (randomized):\n");
+        queue = timer_wheel_create(allocator, 1);
+        reference = timer_heap_create(allocator);
+        error = (NULL == queue || NULL == reference) || run_random(reference);
+        printf("%s\n", !error ? "OK" : "FAILED");
+        if (NULL != queue) {
+            timer_queue_destroy(queue);
+        }
+        if (NULL != reference) {
+            timer_queue_destroy(reference);
+        }
+    }
+
+    if (!error) {
+        printf("monotonic clock:\n");
+        start = timer_now();
+        error = timer_now() < start;
+        printf("%s\n", !error ? "OK" : "FAILED");
+    }
+
+    return !error ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -40,6 +40,22 @@ typedef struct {
  */
 typedef int (allocator_function_t)(allocation_t *allocation, size_t size);
 
+/** Aligned memory allocator function
+ * @param[in,out] allocation memory allocation handle
+ * @param         size       minimum new size of memory (non-zero)
+ * @param         alignment  required alignment of memory (a power of 2)
+ * @retval 0  success
+ * @retval -1 error
+ * @pre @p allocation must be initialized
+ * @post Upon success, @p allocation has been updated to reflect changes, and
+ *       @p allocation->memory is a multiple of @p alignment
+ * @post Upon failure, @p allocation has not been changed
+ * @note Memory allocated by this function may be resized or freed by the
+ *       (unaligned) allocator function, which need not preserve alignment
+ */
+typedef int (allocator_aligned_function_t)(allocation_t *allocation,
+    size_t size, size_t alignment);
+
 /** Memory allocator destructor function
  * @param[in,out] allocator allocator instance
  * @post @p allocator may no longer be used
@@ -52,6 +68,8 @@ struct allocator {
     allocator_function_t *const allocate;
     /** Memory allocator instance destructor */
     allocator_destroy_function_t *const destroy;
+    /** Aligned memory (re)allocator function (or @c NULL if unsupported) */
+    allocator_aligned_function_t *const aligned;
 };
 
 #ifdef __cplusplus
@@ -93,6 +111,23 @@ static inline void allocation_init(allocation_t *allocation,
 int allocation_realloc_array(allocation_t *allocation, size_t nmemb,
     size_t size);
 
+/** Aligned @c realloc() helper function
+ * @param[in,out] allocation memory allocation handle
+ * @param         size       size to allocate (or 0 to free)
+ * @param         alignment  required alignment (a power of 2)
+ * @retval 0  success
+ * @retval -1 error
+ * @pre @p allocation must point to an initialized, valid allocation
+ * @post Upon success, @p allocation->memory and @p allocation->size have been
+ *       updated to reflect changes, and @p allocation->memory is a multiple
+ *       of @p alignment
+ * @post Upon failure, @p allocation has not been changed
+ * @note If @p alignment is not a power of 2, or the allocator does not support
+ *       aligned allocation, this function shall fail with @c EINVAL
+ */
+int allocation_realloc_aligned(allocation_t *allocation, size_t size,
+    size_t alignment);
+
 /** @c free() helper function
  * @param[in,out] allocation memory allocation handle
  * @pre @p allocation must point to an initialized, valid allocation
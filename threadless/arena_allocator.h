@@ -0,0 +1,48 @@
+/* threadless.io
+ * Copyright (c) 2016 Justin R. Cutler
+ * Licensed under the MIT License. See LICENSE file in the project root for
+ * full license information.
+ */
+/** @file
+ * arena (bump-pointer) allocator interface definition
+ * @author Justin R. Cutler <justin.r.cutler@gmail.com>
+ */
+#ifndef THREADLESS_ARENA_ALLOCATOR_H
+#define THREADLESS_ARENA_ALLOCATOR_H
+
+/* size_t */
+#include <stddef.h>
+
+/* allocator_t */
+#include <threadless/allocation.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/** Create an arena allocator instance
+ * @param[in,out] backing    allocator used to obtain chunks
+ * @param         chunk_size size of each chunk (or 0 for a default size)
+ * @retval non-NULL new allocator
+ * @retval NULL     error (check @c errno for reason)
+ * @post upon success, return value must be passed to allocator_destroy()
+ * @note Allocations are served from chunks by bumping a pointer. The most
+ *       recent allocation may grow, shrink or be freed in place; freeing any
+ *       other allocation is a no-op. All memory is released at once by
+ *       allocator_destroy() (or arena_allocator_reset()).
+ */
+allocator_t *arena_allocator_create(allocator_t *backing, size_t chunk_size);
+
+/** Release all memory allocated from an arena allocator
+ * @param[in,out] allocator arena allocator instance
+ * @pre @p allocator must have been returned by arena_allocator_create()
+ * @post All allocations from @p allocator are invalid; the most recent chunk
+ *       is retained for reuse
+ */
+void arena_allocator_reset(allocator_t *allocator);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* THREADLESS_ARENA_ALLOCATOR_H */
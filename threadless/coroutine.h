@@ -14,13 +14,29 @@
 #include <stdbool.h>
 /* NULL, size_t */
 #include <stddef.h>
+/* uint64_t */
+#include <stdint.h>
 
 /* allocator_t */
 #include <threadless/allocation.h>
 
+/** Number of coroutine_stack_histogram() buckets */
+enum {
+    COROUTINE_STACK_HISTOGRAM_SIZE = 32,
+};
+
 /** Opaque coroutine type */
 typedef struct coroutine coroutine_t;
 
+/** Opaque coroutine pool type */
+typedef struct coroutine_pool coroutine_pool_t;
+
+/** Opaque shared coroutine stack type */
+typedef struct coroutine_stack coroutine_stack_t;
+
+/** Opaque coroutine scheduler type */
+typedef struct scheduler scheduler_t;
+
 /** Coroutine function type
  * @param[in,out] coro coroutine
  * @param[in,out] data data passed via first call to coroutine_resume()
@@ -34,6 +50,28 @@ typedef void *(coroutine_function_t)(coroutine_t *coro, void *data);
  */
 typedef void (coroutine_deferred_function_t)(void *data);
 
+/** Coroutine instrumentation hook function type
+ * @param[in,out] coro coroutine
+ * @param[in,out] data user-defined data (see coroutine_hooks_t)
+ */
+typedef void (coroutine_hook_function_t)(coroutine_t *coro, void *data);
+
+/** Coroutine instrumentation hooks (any of which may be @c NULL) */
+typedef struct {
+    /** called once a coroutine is created (or acquired from a pool) */
+    coroutine_hook_function_t *create;
+    /** called before switching to a coroutine (resume or transfer) */
+    coroutine_hook_function_t *resume;
+    /** called before switching from a coroutine (yield, transfer or end) */
+    coroutine_hook_function_t *yield;
+    /** called once a coroutine's function has returned */
+    coroutine_hook_function_t *end;
+    /** called before a coroutine is destroyed (or released to a pool) */
+    coroutine_hook_function_t *destroy;
+    /** user-defined data passed to each hook */
+    void *data;
+} coroutine_hooks_t;
+
 #ifdef __cplusplus
 extern "C" {
 #endif /* __cplusplus */
@@ -46,14 +84,65 @@ extern "C" {
  * @retval NULL     error (check @c errno for reason)
  * @post upon success, return value may be passed to coroutine_resume()
  * @post upon success, return value must be passed to coroutine_destroy()
+ * @note The stack is placed at the start of the memory obtained from
+ *       @p allocator, so a guard page below the allocation (see
+ *       mmap_allocator_create()) catches stack overflow
  */
 coroutine_t *coroutine_create(allocator_t *allocator,
     coroutine_function_t *function, size_t stack_size);
 
+/** Create a stack to be shared by coroutines
+ * @param[in,out] allocator allocator to use to create/destroy memory
+ * @param         size      stack size
+ * @retval non-NULL new shared stack
+ * @retval NULL     error (check @c errno for reason)
+ * @post upon success, return value may be passed to
+ *       coroutine_create_shared()
+ * @post upon success, return value must be passed to
+ *       coroutine_stack_destroy()
+ */
+coroutine_stack_t *coroutine_stack_create(allocator_t *allocator,
+    size_t size);
+
+/** Destroy a shared coroutine stack
+ * @param[in,out] stack stack to destroy (or @c NULL)
+ * @pre all coroutines created with @p stack must have been destroyed
+ * @post @p stack may no longer be used
+ */
+void coroutine_stack_destroy(coroutine_stack_t *stack);
+
+/** Create a coroutine that runs on a shared stack
+ * @param[in,out] allocator allocator to use to create/destroy memory
+ *                          (including the saved stack contents)
+ * @param         function  function to run in coroutine
+ * @param[in,out] stack     stack to run on
+ * @retval non-NULL new coroutine
+ * @retval NULL     error (check @c errno for reason)
+ * @post upon success, return value may be passed to coroutine_resume()
+ * @post upon success, return value must be passed to coroutine_destroy()
+ * @note When a coroutine is resumed (or transferred to) while another
+ *       suspended coroutine occupies @p stack, the used portion of @p stack
+ *       is first copied to a buffer owned by the other coroutine (grown as
+ *       needed), and the resumed coroutine's saved contents are copied back.
+ *       Memory per suspended coroutine is thus proportional to its stack
+ *       usage, at the cost of a copy per switch between sharing coroutines.
+ * @note Resuming fails (returning @c NULL with @c errno set to @c EBUSY) if
+ *       @p stack is in use by a running coroutine (i.e., a coroutine may not
+ *       resume or transfer to another coroutine sharing its stack), and
+ *       (with @c errno set to @c ENOMEM) if the save buffer cannot be grown
+ * @warning Addresses of (and pointers into) a suspended coroutine's stack
+ *          variables are invalid while another coroutine uses @p stack
+ */
+coroutine_t *coroutine_create_shared(allocator_t *allocator,
+    coroutine_function_t *function, coroutine_stack_t *stack);
+
 /** Destroy a coroutine
  * @param[in,out] coro coroutine to destroy
- * @pre @p coro must have been returned by coroutine_create()
+ * @pre @p coro must have been returned by coroutine_create() (or
+ *      coroutine_create_shared() or coroutine_pool_acquire())
  * @post @p coro may no longer be used
+ * @note Coroutines acquired from a pool are released via
+ *       coroutine_pool_release()
  */
 void coroutine_destroy(coroutine_t *coro);
 
@@ -65,11 +154,22 @@ void coroutine_destroy(coroutine_t *coro);
  */
 bool coroutine_ended(const coroutine_t *coro);
 
+/** Test if a coroutine runs on a shared stack
+ * @param[in] coro coroutine to test
+ * @retval true  coroutine was created by coroutine_create_shared()
+ * @retval false coroutine owns its stack
+ * @note Stack addresses of a coroutine on a shared stack must not be handed
+ *       to anything that may access them while the coroutine is suspended
+ *       (e.g., asynchronous kernel I/O)
+ */
+bool coroutine_stack_shared(const coroutine_t *coro);
+
 /** Resume a coroutine, passing a value to coroutine_yield()
  * @param[in,out] coro  coroutine to resume
  * @param[in,out] value value to pass (to initial call or as return from
  *                      coroutine_yield())
- * @returns value passed by @p coro to coroutine_yield()
+ * @returns value passed by @p coro to coroutine_yield() (or by a coroutine
+ *          @p coro switched to via coroutine_transfer())
  * @pre @p coro must have been returned by coroutine_create()
  */
 void *coroutine_resume(coroutine_t *coro, void *value);
@@ -82,6 +182,88 @@ void *coroutine_resume(coroutine_t *coro, void *value);
  */
 void *coroutine_yield(coroutine_t *coro, void *value);
 
+/** Switch directly from one coroutine to another, passing a value
+ * @param[in,out] from  running coroutine to suspend
+ * @param[in,out] to    suspended coroutine to switch to
+ * @param[in,out] value value to pass to @p to (to initial call or as return
+ *                      from coroutine_yield() or coroutine_transfer())
+ * @returns value passed to @p from when it is next resumed (or transferred
+ *          to)
+ * @pre @p from must be the running coroutine; @p to must not be running
+ * @post @p to runs in place of @p from: when @p to yields (or ends), control
+ *       returns to the coroutine_resume() (or scheduler_run()) call that
+ *       resumed @p from, and @p from remains suspended until resumed or
+ *       transferred to again
+ * @note One context switch, instead of two via a common resumer (e.g.,
+ *       between pipeline stages)
+ */
+void *coroutine_transfer(coroutine_t *from, coroutine_t *to, void *value);
+
+/** Sample coroutine stacks for stack usage measurement
+ * @param period paint the stack of one in @p period coroutines created (or
+ *               acquired from a pool), or none if @c 0 (the default)
+ * @note Painting fills the whole stack, so it costs a @c memset() of the
+ *       stack (and commits all of its pages) per sampled coroutine
+ * @note Coroutines on shared stacks are not sampled
+ */
+void coroutine_stack_paint_sample(unsigned period);
+
+/** Paint a coroutine's stack for stack usage measurement
+ * @param[in,out] coro coroutine
+ * @pre @p coro must not have been resumed since being created (or acquired
+ *      from a pool)
+ * @post coroutine_stack_high_water() reports @p coro's stack usage
+ * @note Has no effect on coroutines on shared stacks
+ */
+void coroutine_stack_paint(coroutine_t *coro);
+
+/** Get the maximum stack usage of a coroutine
+ * @param[in] coro coroutine
+ * @returns maximum number of stack bytes used so far (or @c 0 if @p coro's
+ *          stack is not painted)
+ * @note Stack that was written with the paint pattern itself is not
+ *       counted, so the result may rarely be an underestimate
+ */
+size_t coroutine_stack_high_water(const coroutine_t *coro);
+
+/** Get the histogram of painted coroutine stack usage
+ * @param[out] histogram bucket @c i receives the number of painted
+ *                       coroutines destroyed (or released to a pool) with
+ *                       maximum stack usage in [2^i, 2^(i+1)) bytes (bucket
+ *                       @c 0 also counts @c 0, the last bucket also counts
+ *                       larger usage)
+ */
+void coroutine_stack_histogram(
+    size_t histogram[COROUTINE_STACK_HISTOGRAM_SIZE]);
+
+/** Reset the histogram of painted coroutine stack usage */
+void coroutine_stack_histogram_reset(void);
+
+/** Install coroutine instrumentation hooks
+ * @param[in] hooks hooks to install (copied), or @c NULL to disable
+ *                  instrumentation (the default)
+ * @note While instrumentation is enabled (even with all hooks @c NULL),
+ *       coroutine_switches() and coroutine_run_time() are maintained;
+ *       while it is disabled, switching costs one branch
+ * @note Hooks run on the stack of the coroutine switching to or from (or of
+ *       the resumer), and must not switch coroutines
+ */
+void coroutine_hooks_set(const coroutine_hooks_t *hooks);
+
+/** Get the number of times a coroutine was switched to
+ * @param[in] coro coroutine
+ * @returns number of resumes of (and transfers to) @p coro while
+ *          instrumentation was enabled
+ */
+uint64_t coroutine_switches(const coroutine_t *coro);
+
+/** Get the time a coroutine has run
+ * @param[in] coro coroutine
+ * @returns cumulative time (nanoseconds, per @c CLOCK_MONOTONIC) between
+ *          switches to and from @p coro while instrumentation was enabled
+ */
+uint64_t coroutine_run_time(const coroutine_t *coro);
+
 /** Defer a function call until coroutine termination
  * @param[in,out] coro     coroutine
  * @param         function function to call when @p coro terminates
@@ -90,10 +272,136 @@ void *coroutine_yield(coroutine_t *coro, void *value);
  * @retval -1 error
  * @post @p function will be called with @p data when @p coro terminates
  * @note Registered functions will be called in reverse order of registration
+ * @note The first few registrations are stored within @p coro itself; only
+ *       further registrations allocate memory
  */
 int coroutine_defer(coroutine_t *coro, coroutine_deferred_function_t *function,
     void *data);
 
+/** Cancel a deferred function call
+ * @param[in,out] coro     coroutine
+ * @param         function function passed to coroutine_defer()
+ * @param         data     user-defined pointer passed to coroutine_defer()
+ * @retval 0  success
+ * @retval -1 error (no matching registration; @c errno is @c ENOENT)
+ * @post The most recent matching registration has been removed, so
+ *       @p function will not be called with @p data when @p coro terminates
+ *       (unless registered more than once)
+ */
+int coroutine_defer_cancel(coroutine_t *coro,
+    coroutine_deferred_function_t *function, void *data);
+
+/** Create a coroutine pool
+ * @param[in,out] allocator  allocator to use to create/destroy memory
+ * @param         stack_size stack size of pooled coroutines
+ * @param         capacity   maximum number of idle coroutines to retain
+ * @retval non-NULL new coroutine pool
+ * @retval NULL     error (check @c errno for reason)
+ * @post upon success, return value must be passed to coroutine_pool_destroy()
+ */
+coroutine_pool_t *coroutine_pool_create(allocator_t *allocator,
+    size_t stack_size, size_t capacity);
+
+/** Destroy a coroutine pool
+ * @param[in,out] pool coroutine pool to destroy
+ * @pre All coroutines acquired from @p pool must have been released
+ * @post @p pool may no longer be used
+ */
+void coroutine_pool_destroy(coroutine_pool_t *pool);
+
+/** Free idle coroutines held by a coroutine pool
+ * @param[in,out] pool  coroutine pool
+ * @param         count maximum number of idle coroutines to keep
+ */
+void coroutine_pool_trim(coroutine_pool_t *pool, size_t count);
+
+/** Acquire a coroutine from a pool
+ * @param[in,out] pool     coroutine pool
+ * @param         function function to run in coroutine
+ * @retval non-NULL coroutine (reused if possible, created otherwise)
+ * @retval NULL     error (check @c errno for reason)
+ * @post upon success, return value may be passed to coroutine_resume()
+ * @post upon success, return value must be passed to coroutine_pool_release()
+ *       (or coroutine_destroy())
+ * @note Reused stacks are not cleared
+ */
+coroutine_t *coroutine_pool_acquire(coroutine_pool_t *pool,
+    coroutine_function_t *function);
+
+/** Release a coroutine to its pool
+ * @param[in,out] coro coroutine to release
+ * @pre @p coro must have been returned by coroutine_pool_acquire()
+ * @post Deferred functions registered with @p coro have been called
+ * @post @p coro may no longer be used
+ */
+void coroutine_pool_release(coroutine_t *coro);
+
+/** Create a coroutine scheduler
+ * @param[in,out] allocator allocator to use to create/destroy memory
+ * @retval non-NULL new scheduler
+ * @retval NULL     error (check @c errno for reason)
+ * @post upon success, return value must be passed to scheduler_destroy()
+ */
+scheduler_t *scheduler_create(allocator_t *allocator);
+
+/** Destroy a coroutine scheduler
+ * @param[in,out] scheduler scheduler to destroy
+ * @pre No coroutines spawned on @p scheduler remain (see scheduler_count())
+ * @post @p scheduler may no longer be used
+ */
+void scheduler_destroy(scheduler_t *scheduler);
+
+/** Spawn a coroutine on a scheduler
+ * @param[in,out] scheduler scheduler
+ * @param[in,out] coro      coroutine (not yet resumed; ownership passes to
+ *                          @p scheduler)
+ * @param[in,out] data      data to pass via first resume
+ * @post @p coro is ready (see coroutine_ready())
+ * @post @p coro is destroyed (via coroutine_destroy()) by @p scheduler once
+ *       it has ended
+ * @note Spawned coroutines must only be resumed by scheduler_run(); they
+ *       yield (via coroutine_yield()) back to it, and are resumed again once
+ *       made ready. A coroutine switched to via coroutine_transfer() also
+ *       yields back to scheduler_run(), which destroys it if it has ended
+ *       (and was spawned on the same scheduler)
+ */
+void coroutine_spawn(scheduler_t *scheduler, coroutine_t *coro, void *data);
+
+/** Make a spawned coroutine ready to run
+ * @param[in,out] coro  coroutine (spawned via coroutine_spawn())
+ * @param[in,out] value value to return from coroutine_yield() when resumed
+ * @post @p coro is at the back of its scheduler's ready queue (unless it was
+ *       ready already, in which case this has no effect)
+ * @note May be called from any context, including @p coro itself (to let
+ *       other ready coroutines run before yielding). Never allocates: the
+ *       queue links are part of @p coro
+ */
+void coroutine_ready(coroutine_t *coro, void *value);
+
+/** Resume ready coroutines
+ * @param[in,out] scheduler scheduler
+ * @param         max       maximum number of coroutines to resume (or 0 for
+ *                          no limit)
+ * @returns number of coroutines resumed
+ * @post Ready coroutines have been resumed in first-in first-out order until
+ *       none remained ready or @p max had been resumed
+ * @note Bounding @p max (e.g., between polls for I/O) keeps coroutines that
+ *       repeatedly make themselves ready from starving others
+ */
+size_t scheduler_run(scheduler_t *scheduler, size_t max);
+
+/** Get the number of ready coroutines
+ * @param[in] scheduler scheduler
+ * @returns number of coroutines in the ready queue of @p scheduler
+ */
+size_t scheduler_ready_count(const scheduler_t *scheduler);
+
+/** Get the number of live coroutines
+ * @param[in] scheduler scheduler
+ * @returns number of coroutines spawned on @p scheduler that have not ended
+ */
+size_t scheduler_count(const scheduler_t *scheduler);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -0,0 +1,55 @@
+/* threadless.io
+ * Copyright (c) 2016 Justin R. Cutler
+ * Licensed under the MIT License. See LICENSE file in the project root for
+ * full license information.
+ */
+/** @file
+ * coroutine trace exporter interface definition
+ * @author Justin R. Cutler <justin.r.cutler@gmail.com>
+ */
+#ifndef THREADLESS_COROUTINE_TRACE_H
+#define THREADLESS_COROUTINE_TRACE_H
+
+/* FILE */
+#include <stdio.h>
+
+/* allocator_t */
+#include <threadless/allocation.h>
+
+/** Opaque coroutine trace type */
+typedef struct coroutine_trace coroutine_trace_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/** Start tracing coroutines to a Chrome trace event (JSON) file
+ * @param[in,out] allocator allocator to use to create/destroy memory
+ * @param[in,out] file      file to write trace events to
+ * @retval non-NULL new trace
+ * @retval NULL     error (check @c errno for reason)
+ * @post upon success, return value must be passed to coroutine_trace_stop()
+ * @note Installs coroutine instrumentation hooks (replacing any others; see
+ *       coroutine_hooks_set()). Each coroutine is shown as a thread (its
+ *       header address as thread ID), with a slice per run between a switch
+ *       to and from it, and instant events for creation, end and
+ *       destruction. The output may be loaded by @c chrome://tracing or
+ *       Perfetto (https://ui.perfetto.dev)
+ */
+coroutine_trace_t *coroutine_trace_start(allocator_t *allocator, FILE *file);
+
+/** Stop tracing coroutines
+ * @param[in,out] trace trace to stop
+ * @retval 0  success
+ * @retval -1 error writing trace (check @c errno for reason)
+ * @post Instrumentation hooks are uninstalled, the trace is terminated and
+ *       @p file is flushed (but not closed)
+ * @post @p trace may no longer be used
+ */
+int coroutine_trace_stop(coroutine_trace_t *trace);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* THREADLESS_COROUTINE_TRACE_H */
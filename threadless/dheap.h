@@ -0,0 +1,144 @@
+/* threadless.io
+ * Copyright (c) 2016 Justin R. Cutler
+ * Licensed under the MIT License. See LICENSE file in the project root for
+ * full license information.
+ */
+/** @file
+ * d-ary keyed heap interface definition
+ * @author Justin R. Cutler <justin.r.cutler@gmail.com>
+ */
+#ifndef THREADLESS_DHEAP_H
+#define THREADLESS_DHEAP_H
+
+/* size_t, NULL */
+#include <stddef.h>
+/* uint64_t */
+#include <stdint.h>
+
+/* allocation_t, allocator_t, allocation_init */
+#include <threadless/allocation.h>
+
+/** Number of children per d-ary heap node */
+#define DHEAP_ARITY 4
+
+/** d-ary heap descriptor type */
+typedef struct dheap dheap_t;
+
+/** d-ary heap node type */
+typedef struct {
+    /** Back-pointer to containing heap */
+    dheap_t *heap;
+    /** Current index within @p heap */
+    size_t index;
+} dheap_node_t;
+
+/** d-ary heap storage entry type */
+typedef struct {
+    /** Sort key (lowest key is "best") */
+    uint64_t key;
+    /** Node with key @p key */
+    dheap_node_t *node;
+} dheap_entry_t;
+
+/** d-ary heap descriptor structure
+ * Unlike @c heap_t, keys are stored inline next to each node pointer, so
+ * restoring the heap invariant compares contiguous keys without touching
+ * (or calling back into) the nodes themselves.
+ */
+struct dheap {
+    /** Heap entry storage */
+    allocation_t allocation;
+    /** Number of nodes in heap */
+    size_t count;
+    /** Number of nodes @p allocation can hold */
+    size_t capacity;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/** Initialize a d-ary heap descriptor
+ * @param[out] heap      heap to initialize
+ * @param      allocator allocator instance
+ * @post @p heap represents an empty heap
+ */
+static inline void dheap_init(dheap_t *heap, allocator_t *allocator)
+{
+    allocation_init(&heap->allocation, allocator);
+    heap->count = 0;
+    heap->capacity = 0;
+}
+
+/** Peek at the "best" (lowest key) node in @p heap
+ * @param[in] heap heap
+ * @retval NULL     @p heap is empty
+ * @retval non-NULL pointer to "best" node in @p heap
+ */
+static inline dheap_node_t *dheap_peek(const dheap_t *heap)
+{
+    dheap_entry_t *storage = heap->count ? heap->allocation.memory : NULL;
+    return storage ? storage->node : NULL;
+}
+
+/** Get the key of a @p node
+ * @param[in] node node
+ * @returns key of @p node
+ * @pre @p node must be in a heap
+ */
+static inline uint64_t dheap_key(const dheap_node_t *node)
+{
+    const dheap_entry_t *storage = node->heap->allocation.memory;
+    return storage[node->index].key;
+}
+
+/** Reserve storage for (at least) @p count nodes in @p heap
+ * @param[in,out] heap  heap
+ * @param         count number of nodes
+ * @retval 0  success
+ * @retval -1 error
+ */
+int dheap_reserve(dheap_t *heap, size_t count);
+
+/** Push a @p node with a given @p key into @p heap
+ * @param[in,out] heap heap
+ * @param[in,out] node node
+ * @param         key  sort key
+ * @retval 0  success
+ * @retval -1 error
+ */
+int dheap_push(dheap_t *heap, dheap_node_t *node, uint64_t key);
+
+/** Change the key of a @p node
+ * @param[in,out] node node
+ * @param         key  new sort key
+ * @pre @p node must be in a heap
+ */
+void dheap_update(dheap_node_t *node, uint64_t key);
+
+/** Remove an arbitrary @p node from its heap
+ * @param[in,out] node node
+ * @pre @p node must be in a heap
+ * @post @p node is no longer in a heap
+ */
+void dheap_remove(dheap_node_t *node);
+
+/** Remove and return the "best" (lowest key) node in @p heap
+ * @param[in,out] heap heap
+ * @retval NULL     @p heap was empty
+ * @retval non-NULL pointer to removed "best" node from @p heap
+ */
+dheap_node_t *dheap_pop(dheap_t *heap);
+
+/** Finalize a d-ary heap
+ * @param[in,out] heap heap
+ * @post All nodes have been removed from @p heap and all backing memory has
+ *       been released
+ */
+void dheap_fini(dheap_t *heap);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* THREADLESS_DHEAP_H */
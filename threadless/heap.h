@@ -43,6 +43,8 @@ struct heap {
     allocation_t allocation;
     /** Number of nodes in heap */
     size_t count;
+    /** Number of nodes @p allocation can hold */
+    size_t capacity;
     /** Heap node comparison function */
     heap_compare_function_t *compare;
 };
@@ -62,6 +64,7 @@ static inline void heap_init(heap_t *heap, allocator_t *allocator,
 {
     allocation_init(&heap->allocation, allocator);
     heap->count = 0;
+    heap->capacity = 0;
     heap->compare = compare;
 }
 
@@ -76,6 +79,24 @@ static inline heap_node_t *heap_peek(const heap_t *heap)
     return storage ? *storage : NULL;
 }
 
+/** Reserve storage for (at least) @p count nodes in @p heap
+ * @param[in,out] heap  heap
+ * @param         count number of nodes
+ * @retval 0  success
+ * @retval -1 error
+ * @post Upon success, @p heap can hold @p count nodes without allocating
+ * @note Storage grows geometrically and is only shrunk once @p heap is less
+ *       than 1/4 full, so pushes and pops do not allocate in steady state
+ */
+int heap_reserve(heap_t *heap, size_t count);
+
+/** Release unused storage of @p heap
+ * @param[in,out] heap heap
+ * @post Storage has been halved (repeatedly) while @p heap was less than 1/4
+ *       full
+ */
+void heap_shrink(heap_t *heap);
+
 /** Push a @p node into @p heap
  * @param[in,out] heap heap
  * @param[in,out] node node
@@ -84,6 +105,32 @@ static inline heap_node_t *heap_peek(const heap_t *heap)
  */
 int heap_push(heap_t *heap, heap_node_t *node);
 
+/** Push multiple @p nodes into @p heap
+ * @param[in,out] heap  heap
+ * @param[in,out] nodes array of @p count nodes
+ * @param         count number of nodes
+ * @retval 0  success
+ * @retval -1 error
+ * @post Upon failure, @p heap has not been changed
+ * @note Storage is grown once; if @p count is at least the current size of
+ *       @p heap, the heap is rebuilt bottom-up in O(n) time
+ */
+int heap_push_many(heap_t *heap, heap_node_t *const *nodes, size_t count);
+
+/** Initialize a heap descriptor from an array of nodes
+ * @param[out]    heap      heap to initialize
+ * @param         allocator allocator instance
+ * @param         compare   comparison function
+ * @param[in,out] nodes     array of @p count nodes
+ * @param         count     number of nodes
+ * @retval 0  success
+ * @retval -1 error
+ * @post @p heap has been initialized (even upon failure, in which case it is
+ *       empty)
+ */
+int heap_init_from_array(heap_t *heap, allocator_t *allocator,
+    heap_compare_function_t *compare, heap_node_t *const *nodes, size_t count);
+
 /** Replace an existing @p old node in a heap with a new @p node
  * @param[in,out] old  old node
  * @param[in,out] node new node
@@ -93,6 +140,30 @@ int heap_push(heap_t *heap, heap_node_t *node);
  */
 void heap_replace(heap_node_t *old, heap_node_t *node);
 
+/** Restore the heap invariant after the key of @p node has changed
+ * @param[in,out] node node
+ * @pre @p node must be in a heap
+ * @post @p node has been moved (toward the top or bottom of its heap, as
+ *       needed) to its correct position
+ */
+void heap_update(heap_node_t *node);
+
+/** Restore the heap invariant after @p node has become "better"
+ * @param[in,out] node node
+ * @pre @p node must be in a heap
+ * @pre @p node must not have become "worse"
+ * @post @p node has been moved toward the top of its heap, as needed
+ */
+void heap_decrease_key(heap_node_t *node);
+
+/** Restore the heap invariant after @p node has become "worse"
+ * @param[in,out] node node
+ * @pre @p node must be in a heap
+ * @pre @p node must not have become "better"
+ * @post @p node has been moved toward the bottom of its heap, as needed
+ */
+void heap_increase_key(heap_node_t *node);
+
 /** Remove an arbitrary @p node from its heap
  * @param[in,out] node node
  * @pre @p node must be in a heap
@@ -107,6 +178,18 @@ void heap_remove(heap_node_t *node);
  */
 heap_node_t *heap_pop(heap_t *heap);
 
+/** Remove and return (up to @p max) nodes no "worse" than @p threshold
+ * @param[in,out] heap      heap
+ * @param[in]     threshold node to compare against (need not be in a heap)
+ * @param[out]    nodes     array of (at least) @p max nodes
+ * @param         max       maximum number of nodes to remove
+ * @returns number of nodes removed from @p heap (and stored, "best" first, in
+ *          @p nodes)
+ * @note Storage is resized (at most) once, after all nodes are removed
+ */
+size_t heap_pop_until(heap_t *heap, const heap_node_t *threshold,
+    heap_node_t **nodes, size_t max);
+
 /** Finalize a heap
  * @param[in,out] heap heap
  * @post All nodes have been removed from @p heap and all backing memory has
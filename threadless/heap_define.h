@@ -0,0 +1,190 @@
+/* threadless.io
+ * Copyright (c) 2016 Justin R. Cutler
+ * Licensed under the MIT License. See LICENSE file in the project root for
+ * full license information.
+ */
+/** @file
+ * type-specialized heap generator
+ * @author Justin R. Cutler <justin.r.cutler@gmail.com>
+ */
+#ifndef THREADLESS_HEAP_DEFINE_H
+#define THREADLESS_HEAP_DEFINE_H
+
+/* size_t, NULL */
+#include <stddef.h>
+
+/* container_of */
+#include <threadless/container_of.h>
+/* heap_t, heap_node_t, heap_init, heap_reserve, heap_shrink */
+#include <threadless/heap.h>
+
+/** Define a heap specialized for a given element type
+ * @param name   prefix of generated functions
+ * @param type   element type
+ * @param member name of the @c heap_node_t member in @p type
+ * @param cmp    comparison function (or macro) taking two
+ *               <tt>const type *</tt> and returning <0 if the first is
+ *               "better" (closer to the top of the heap) than the second
+ *
+ * Generates the following @c static @c inline functions operating on a
+ * @c heap_t, in which @p cmp is called directly (and so may be inlined) and
+ * the offset of @p member is known at compile time:
+ * - <tt>void name_init(heap_t *heap, allocator_t *allocator)</tt>
+ * - <tt>type *name_peek(const heap_t *heap)</tt>
+ * - <tt>int name_push(heap_t *heap, type *value)</tt>
+ * - <tt>void name_replace(type *old, type *value)</tt>
+ * - <tt>void name_update(type *value)</tt>
+ * - <tt>void name_remove(type *value)</tt>
+ * - <tt>type *name_pop(heap_t *heap)</tt>
+ *
+ * A heap initialized with <tt>name_init()</tt> remains a valid generic
+ * @c heap_t (e.g. for heap_fini()) whose comparison function is
+ * <tt>name_compare()</tt>.
+ */
+#define THREADLESS_HEAP_DEFINE(name, type, member, cmp) \
+\
+static inline int name##_compare(const heap_node_t *a, const heap_node_t *b) \
+{ \
+    return cmp(container_of(a, const type, member), \
+        container_of(b, const type, member)); \
+} \
+\
+static inline int name##_better(heap_node_t **storage, size_t a, size_t b) \
+{ \
+    return cmp(container_of(storage[a], const type, member), \
+        container_of(storage[b], const type, member)) < 0; \
+} \
+\
+static inline void name##_swap(heap_node_t **storage, size_t a, size_t b) \
+{ \
+    heap_node_t *tmp = storage[a]; \
+    storage[a] = storage[b]; \
+    storage[b] = tmp; \
+    storage[a]->index = a; \
+    storage[b]->index = b; \
+} \
+\
+static inline void name##_sift_down(heap_t *heap, size_t start, size_t pos) \
+{ \
+    heap_node_t **storage = heap->allocation.memory; \
+    while (pos > start) { \
+        size_t parent = (pos - 1) >> 1; \
+        if (!name##_better(storage, pos, parent)) { \
+            break; \
+        } \
+        name##_swap(storage, pos, parent); \
+        pos = parent; \
+    } \
+} \
+\
+static inline void name##_sift_up(heap_t *heap, size_t pos, size_t end) \
+{ \
+    heap_node_t **storage = heap->allocation.memory; \
+    size_t start = pos; \
+    size_t child = (pos << 1) + 1; \
+    while (child < end) { \
+        size_t right = child + 1; \
+        if (right < end && name##_better(storage, right, child)) { \
+            child = right; \
+        } \
+        name##_swap(storage, pos, child); \
+        pos = child; \
+        child = (pos << 1) + 1; \
+    } \
+    name##_sift_down(heap, start, pos); \
+} \
+\
+static inline void name##_init(heap_t *heap, allocator_t *allocator) \
+{ \
+    heap_init(heap, allocator, name##_compare); \
+} \
+\
+static inline type *name##_peek(const heap_t *heap) \
+{ \
+    heap_node_t *node = heap_peek(heap); \
+    return (NULL != node) ? container_of(node, type, member) : NULL; \
+} \
+\
+static inline int name##_push(heap_t *heap, type *value) \
+{ \
+    heap_node_t *node = &(value->member); \
+    if (heap->count == heap->capacity && heap_reserve(heap, heap->count + 1)) { \
+        return -1; \
+    } \
+    node->heap = heap; \
+    node->index = heap->count++; \
+    ((heap_node_t **) heap->allocation.memory)[node->index] = node; \
+    name##_sift_down(heap, 0, node->index); \
+    return 0; \
+} \
+\
+static inline void name##_replace(type *old, type *value) \
+{ \
+    heap_t *heap = old->member.heap; \
+    size_t pos = old->member.index; \
+    old->member.heap = NULL; \
+    old->member.index = 0; \
+    value->member.heap = heap; \
+    value->member.index = pos; \
+    ((heap_node_t **) heap->allocation.memory)[pos] = &(value->member); \
+    name##_sift_up(heap, pos, heap->count); \
+    name##_sift_down(heap, 0, value->member.index); \
+} \
+\
+static inline void name##_update(type *value) \
+{ \
+    heap_t *heap = value->member.heap; \
+    size_t pos = value->member.index; \
+    heap_node_t **storage = heap->allocation.memory; \
+    size_t child = (pos << 1) + 1; \
+    if (pos > 0 && name##_better(storage, pos, (pos - 1) >> 1)) { \
+        name##_sift_down(heap, 0, pos); \
+        return; \
+    } \
+    while (child < heap->count) { \
+        size_t right = child + 1; \
+        if (right < heap->count && name##_better(storage, right, child)) { \
+            child = right; \
+        } \
+        if (!name##_better(storage, child, pos)) { \
+            break; \
+        } \
+        name##_swap(storage, pos, child); \
+        pos = child; \
+        child = (pos << 1) + 1; \
+    } \
+} \
+\
+static inline void name##_remove(type *value) \
+{ \
+    heap_t *heap = value->member.heap; \
+    size_t pos = value->member.index; \
+    if (heap->count) { \
+        heap->count--; \
+        if (pos != heap->count) { \
+            name##_swap(heap->allocation.memory, pos, heap->count); \
+            if (pos > 0 && name##_better(heap->allocation.memory, pos, \
+                (pos - 1) >> 1)) { \
+                name##_sift_down(heap, 0, pos); \
+            } else { \
+                name##_sift_up(heap, pos, heap->count); \
+            } \
+        } \
+        if (heap->count < (heap->capacity >> 2)) { \
+            heap_shrink(heap); \
+        } \
+    } \
+    value->member.heap = NULL; \
+    value->member.index = 0; \
+} \
+\
+static inline type *name##_pop(heap_t *heap) \
+{ \
+    type *value = name##_peek(heap); \
+    if (NULL != value) { \
+        name##_remove(value); \
+    } \
+    return value; \
+}
+
+#endif /* THREADLESS_HEAP_DEFINE_H */
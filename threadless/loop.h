@@ -0,0 +1,313 @@
+/* threadless.io
+ * Copyright (c) 2016 Justin R. Cutler
+ * Licensed under the MIT License. See LICENSE file in the project root for
+ * full license information.
+ */
+/** @file
+ * event loop interface definition
+ * @author Justin R. Cutler <justin.r.cutler@gmail.com>
+ */
+#ifndef THREADLESS_LOOP_H
+#define THREADLESS_LOOP_H
+
+/* size_t */
+#include <stddef.h>
+
+/* socklen_t, struct sockaddr */
+#include <sys/socket.h>
+/* ssize_t */
+#include <sys/types.h>
+/* struct iovec */
+#include <sys/uio.h>
+
+/* allocator_t */
+#include <threadless/allocation.h>
+/* coroutine_t, scheduler_t */
+#include <threadless/coroutine.h>
+/* timer_queue_t */
+#include <threadless/timer_queue.h>
+
+/** Opaque event loop type */
+typedef struct loop loop_t;
+
+/** Event loop wait events */
+enum {
+    /** Wait until file descriptor is readable */
+    LOOP_READ = 1 << 0,
+    /** Wait until file descriptor is writable */
+    LOOP_WRITE = 1 << 1,
+};
+
+/** Event loop backends */
+enum {
+    /** Use @c io_uring(7) if supported by the kernel, @c epoll(7) otherwise */
+    LOOP_BACKEND_DEFAULT = 0,
+    /** Readiness-based backend (@c epoll(7)) */
+    LOOP_BACKEND_EPOLL = 1,
+    /** Completion-based backend (@c io_uring(7)) */
+    LOOP_BACKEND_IO_URING = 2,
+};
+
+/** Event loop timer classes (see loop_timer_queue()) */
+enum {
+    /** Wake-up timers of loop_sleep() (by default, a timer_heap_create()
+     * store: exact, and usually expire)
+     */
+    LOOP_TIMERS_SLEEP = 0,
+    /** Deadlines of loop_timeout() (by default, a timer_wheel_create() store
+     * with 1 ms ticks: O(1), and usually cancelled)
+     */
+    LOOP_TIMERS_TIMEOUT = 1,
+    /** Number of timer classes */
+    LOOP_TIMER_CLASSES = 2,
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/** Create an event loop
+ * @param[in,out] allocator allocator to use to create/destroy memory
+ * @retval non-NULL new event loop
+ * @retval NULL     error (check @c errno for reason)
+ * @post upon success, return value must be passed to loop_destroy()
+ */
+loop_t *loop_create(allocator_t *allocator);
+
+/** Create an event loop using a specific backend
+ * @param[in,out] allocator allocator to use to create/destroy memory
+ * @param         backend   @c LOOP_BACKEND_* constant
+ * @retval non-NULL new event loop
+ * @retval NULL     error (check @c errno for reason)
+ * @post upon success, return value must be passed to loop_destroy()
+ * @note @c LOOP_BACKEND_DEFAULT falls back to @c epoll(7) at runtime if the
+ *       kernel does not support @c io_uring(7) (or lacks the operations used
+ *       here, added in Linux 5.11); requesting @c LOOP_BACKEND_IO_URING
+ *       explicitly fails instead
+ */
+loop_t *loop_create_backend(allocator_t *allocator, int backend);
+
+/** Get the backend of an event loop
+ * @param[in] loop event loop
+ * @returns @c LOOP_BACKEND_EPOLL or @c LOOP_BACKEND_IO_URING
+ */
+int loop_backend(const loop_t *loop);
+
+/** Destroy an event loop
+ * @param[in,out] loop event loop to destroy
+ * @pre No coroutines spawned on @p loop remain (i.e., loop_run() has
+ *      returned 0)
+ * @post @p loop may no longer be used
+ */
+void loop_destroy(loop_t *loop);
+
+/** Spawn a coroutine on an event loop
+ * @param[in,out] loop event loop
+ * @param[in,out] coro coroutine to run (ownership passes to @p loop)
+ * @param[in,out] data data to pass via first call to coroutine_resume()
+ * @post @p coro is ready, and first runs from loop_run()
+ * @post @p coro is destroyed (via coroutine_destroy()) by @p loop when it ends
+ * @note Equivalent to coroutine_spawn() on loop_scheduler(). Coroutines owned
+ *       by @p loop yield via loop_wait(), loop_sleep() (or the I/O functions
+ *       below), which may be called from any coroutine, including another
+ *       coroutine owned by @p loop, or after coroutine_ready()
+ * @note Coroutines on shared stacks (see coroutine_create_shared()) may use
+ *       the loop; with @c io_uring(7), their I/O waits for readiness and then
+ *       calls @c read(2) (etc.) directly, so their descriptors must be
+ *       non-blocking, as they must be with @c epoll(7)
+ */
+void loop_spawn(loop_t *loop, coroutine_t *coro, void *data);
+
+/** Replace the timer store of an event loop for a class of timers
+ * @param[in,out] loop        event loop
+ * @param         timer_class @c LOOP_TIMERS_* constant
+ * @param[in,out] queue       timer store (e.g., from timer_heap_create() or
+ *                            timer_wheel_create(); ownership passes to
+ *                            @p loop)
+ * @retval 0  success (the previous store has been destroyed)
+ * @retval -1 error (check @c errno for reason: @c EINVAL for an invalid
+ *            class or @c NULL @p queue, @c EBUSY if timers of
+ *            @p timer_class are pending)
+ * @post upon success, @p queue is destroyed by loop_destroy() (or by
+ *       replacing it)
+ */
+int loop_timer_queue(loop_t *loop, int timer_class, timer_queue_t *queue);
+
+/** Get the scheduler of an event loop
+ * @param[in,out] loop event loop
+ * @returns scheduler running coroutines owned by @p loop
+ * @note loop_run() resumes a bounded number of ready coroutines between
+ *       polls for I/O, so coroutines made ready via coroutine_ready() do not
+ *       starve those waiting for I/O (and vice versa)
+ */
+scheduler_t *loop_scheduler(loop_t *loop);
+
+/** Run an event loop until all spawned coroutines have ended
+ * @param[in,out] loop event loop
+ * @retval 0  success (no coroutines remain)
+ * @retval -1 error (check @c errno for reason)
+ */
+int loop_run(loop_t *loop);
+
+/** Wait until a file descriptor is ready
+ * @param[in,out] loop   event loop
+ * @param[in,out] coro   calling coroutine (owned by @p loop)
+ * @param         fd     file descriptor
+ * @param         events @c LOOP_READ and/or @c LOOP_WRITE
+ * @retval 0  success (@p fd is ready, or has an error or hang-up pending)
+ * @retval -1 error (check @c errno for reason)
+ * @note Only one coroutine may wait on a given file descriptor at a time
+ */
+int loop_wait(loop_t *loop, coroutine_t *coro, int fd, int events);
+
+/** Set a deadline for the next pseudo-blocking operation
+ * @param[in,out] loop event loop
+ * @param         ms   milliseconds from now (or negative for no deadline;
+ *                     deadlines too far off to represent never expire)
+ * @post The next call to loop_wait() (or one of the I/O functions below) on
+ *       @p loop fails with @c errno set to @c ETIMEDOUT if it has not
+ *       completed by the deadline; that call consumes the deadline
+ * @note Must be called from the coroutine about to perform the operation,
+ *       without yielding in between
+ */
+void loop_timeout(loop_t *loop, long ms);
+
+/** Suspend a coroutine for a period of time
+ * @param[in,out] loop event loop
+ * @param[in,out] coro calling coroutine (owned by @p loop)
+ * @param         ms   milliseconds to sleep for (sleeps too long to
+ *                     represent never end)
+ * @retval 0  success
+ * @retval -1 error (check @c errno for reason)
+ * @note Other coroutines owned by @p loop run while @p coro sleeps
+ */
+int loop_sleep(loop_t *loop, coroutine_t *coro, unsigned long ms);
+
+/** Register buffers for use with loop_read_fixed() and loop_write_fixed()
+ * @param[in,out] loop   event loop
+ * @param[in]     iovecs buffers
+ * @param         count  number of entries in @p iovecs
+ * @retval 0  success
+ * @retval -1 error (check @c errno for reason)
+ * @note With @c io_uring(7), buffers are pinned and mapped once by the kernel
+ *       instead of on every operation; with @c epoll(7), this is a no-op
+ */
+int loop_register_buffers(loop_t *loop, const struct iovec *iovecs,
+    unsigned count);
+
+/** Unregister buffers registered via loop_register_buffers()
+ * @param[in,out] loop event loop
+ * @retval 0  success
+ * @retval -1 error (check @c errno for reason)
+ * @pre No loop_read_fixed() or loop_write_fixed() operation is in progress
+ */
+int loop_unregister_buffers(loop_t *loop);
+
+/** Register file descriptors
+ * @param[in,out] loop  event loop
+ * @param[in]     fds   file descriptors
+ * @param         count number of entries in @p fds
+ * @retval 0  success
+ * @retval -1 error (check @c errno for reason)
+ * @note With @c io_uring(7), operations on registered file descriptors skip
+ *       the per-operation file table lookup (and reference counting); with
+ *       @c epoll(7), this is a no-op. Registered file descriptors are used
+ *       transparently, and must be closed via loop_close()
+ */
+int loop_register_files(loop_t *loop, const int *fds, unsigned count);
+
+/** Unregister file descriptors registered via loop_register_files()
+ * @param[in,out] loop event loop
+ * @retval 0  success
+ * @retval -1 error (check @c errno for reason)
+ */
+int loop_unregister_files(loop_t *loop);
+
+/** Pseudo-blocking @c read(2)
+ * @param[in,out] loop  event loop
+ * @param[in,out] coro  calling coroutine (owned by @p loop)
+ * @param         fd    non-blocking file descriptor
+ * @param[out]    buf   buffer
+ * @param         count size of @p buf
+ * @returns number of bytes read (0 at end of file), or -1 on error (check
+ *          @c errno for reason)
+ */
+ssize_t loop_read(loop_t *loop, coroutine_t *coro, int fd, void *buf,
+    size_t count);
+
+/** Pseudo-blocking @c write(2)
+ * @param[in,out] loop  event loop
+ * @param[in,out] coro  calling coroutine (owned by @p loop)
+ * @param         fd    non-blocking file descriptor
+ * @param[in]     buf   buffer
+ * @param         count number of bytes to write
+ * @returns number of bytes written, or -1 on error (check @c errno for reason)
+ * @note Like @c write(2), this function may write fewer than @p count bytes
+ */
+ssize_t loop_write(loop_t *loop, coroutine_t *coro, int fd, const void *buf,
+    size_t count);
+
+/** Pseudo-blocking @c read(2) into a registered buffer
+ * @param[in,out] loop  event loop
+ * @param[in,out] coro  calling coroutine (owned by @p loop)
+ * @param         fd    non-blocking file descriptor
+ * @param[out]    buf   buffer (within registered buffer @p index)
+ * @param         count size of @p buf
+ * @param         index index of buffer passed to loop_register_buffers()
+ * @returns number of bytes read (0 at end of file), or -1 on error (check
+ *          @c errno for reason)
+ */
+ssize_t loop_read_fixed(loop_t *loop, coroutine_t *coro, int fd, void *buf,
+    size_t count, unsigned index);
+
+/** Pseudo-blocking @c write(2) from a registered buffer
+ * @param[in,out] loop  event loop
+ * @param[in,out] coro  calling coroutine (owned by @p loop)
+ * @param         fd    non-blocking file descriptor
+ * @param[in]     buf   buffer (within registered buffer @p index)
+ * @param         count number of bytes to write
+ * @param         index index of buffer passed to loop_register_buffers()
+ * @returns number of bytes written, or -1 on error (check @c errno for reason)
+ */
+ssize_t loop_write_fixed(loop_t *loop, coroutine_t *coro, int fd,
+    const void *buf, size_t count, unsigned index);
+
+/** Pseudo-blocking @c accept(2)
+ * @param[in,out] loop    event loop
+ * @param[in,out] coro    calling coroutine (owned by @p loop)
+ * @param         fd      non-blocking listening socket
+ * @param[out]    addr    peer address (or @c NULL)
+ * @param[in,out] addrlen size of @p addr (or @c NULL)
+ * @returns new non-blocking socket, or -1 on error (check @c errno for
+ *          reason)
+ */
+int loop_accept(loop_t *loop, coroutine_t *coro, int fd,
+    struct sockaddr *addr, socklen_t *addrlen);
+
+/** Pseudo-blocking @c connect(2)
+ * @param[in,out] loop    event loop
+ * @param[in,out] coro    calling coroutine (owned by @p loop)
+ * @param         fd      non-blocking socket
+ * @param[in]     addr    peer address
+ * @param         addrlen size of @p addr
+ * @retval 0  success
+ * @retval -1 error (check @c errno for reason)
+ */
+int loop_connect(loop_t *loop, coroutine_t *coro, int fd,
+    const struct sockaddr *addr, socklen_t addrlen);
+
+/** Pseudo-blocking @c close(2)
+ * @param[in,out] loop event loop
+ * @param[in,out] coro calling coroutine (owned by @p loop)
+ * @param         fd   file descriptor
+ * @retval 0  success
+ * @retval -1 error (check @c errno for reason)
+ * @post @p fd has been unregistered (see loop_register_files())
+ */
+int loop_close(loop_t *loop, coroutine_t *coro, int fd);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* THREADLESS_LOOP_H */
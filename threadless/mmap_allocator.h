@@ -13,6 +13,34 @@
 /* allocator_t */
 #include <threadless/allocation.h>
 
+/** @c mmap(3) allocator flags */
+enum {
+    /** Stack allocation mode: place an inaccessible guard page below each
+     * allocation and reserve (rather than commit) memory, so that pages are
+     * only committed once touched
+     */
+    MMAP_ALLOCATOR_STACK = 1 << 0,
+    /** Huge page mode: round sizes up to the huge page size and use
+     * @c MAP_HUGETLB, falling back to regular pages advised with
+     * @c MADV_HUGEPAGE (e.g. if no huge pages are reserved)
+     */
+    MMAP_ALLOCATOR_HUGE_PAGES = 1 << 1,
+};
+
+/** @c mmap(3) allocator statistics */
+typedef struct {
+    /** Mappings backed by explicit (@c MAP_HUGETLB) huge pages */
+    size_t hugetlb_maps;
+    /** Mappings advised to use transparent huge pages */
+    size_t madvise_maps;
+    /** Mappings using regular pages only */
+    size_t regular_maps;
+    /** Allocations served from retained mappings */
+    size_t cache_hits;
+    /** Bytes currently held in retained mappings */
+    size_t cached_bytes;
+} mmap_allocator_stats_t;
+
 #ifdef __cplusplus
 extern "C" {
 #endif /* __cplusplus */
@@ -22,6 +50,48 @@ extern "C" {
  */
 allocator_t *mmap_allocator_get(void);
 
+/** Create an @c mmap(3) allocator instance
+ * @param flags bitwise OR of zero or more @c MMAP_ALLOCATOR_* flags
+ * @retval non-NULL new allocator
+ * @retval NULL     error (check @c errno for reason)
+ * @post upon success, return value must be passed to allocator_destroy()
+ * @note An allocator created with @c MMAP_ALLOCATOR_STACK is suitable for
+ *       coroutine_create(): an overflowing coroutine stack faults on the
+ *       guard page rather than corrupting memory
+ */
+allocator_t *mmap_allocator_create(int flags);
+
+/** Get statistics of an @c mmap(3) allocator
+ * @param[in]  allocator @c mmap(3) allocator instance
+ * @param[out] stats     statistics
+ * @pre @p allocator must have been returned by mmap_allocator_get() or
+ *      mmap_allocator_create()
+ */
+void mmap_allocator_stats(allocator_t *allocator,
+    mmap_allocator_stats_t *stats);
+
+/** Set the retained mapping cache limit of an @c mmap(3) allocator
+ * @param[in,out] allocator @c mmap(3) allocator instance
+ * @param         limit     maximum number of bytes to retain (0 disables)
+ * @pre @p allocator must have been returned by mmap_allocator_get() or
+ *      mmap_allocator_create()
+ * @post Retained mappings beyond @p limit have been unmapped
+ * @note Freed mappings are retained (up to @p limit bytes, and a bounded
+ *       number of mappings) instead of being unmapped; their pages are
+ *       returned to the kernel with @c MADV_FREE (or @c MADV_DONTNEED). A
+ *       later allocation of the same rounded size reuses a retained mapping,
+ *       avoiding @c mmap(2)/@c munmap(2) churn. The cache is disabled by
+ *       default.
+ */
+void mmap_allocator_cache_limit(allocator_t *allocator, size_t limit);
+
+/** Unmap all retained mappings of an @c mmap(3) allocator
+ * @param[in,out] allocator @c mmap(3) allocator instance
+ * @pre @p allocator must have been returned by mmap_allocator_get() or
+ *      mmap_allocator_create()
+ */
+void mmap_allocator_trim(allocator_t *allocator);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
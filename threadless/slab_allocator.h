@@ -0,0 +1,51 @@
+/* threadless.io
+ * Copyright (c) 2016 Justin R. Cutler
+ * Licensed under the MIT License. See LICENSE file in the project root for
+ * full license information.
+ */
+/** @file
+ * size-class slab allocator interface definition
+ * @author Justin R. Cutler <justin.r.cutler@gmail.com>
+ */
+#ifndef THREADLESS_SLAB_ALLOCATOR_H
+#define THREADLESS_SLAB_ALLOCATOR_H
+
+/* size_t */
+#include <stddef.h>
+
+/* allocator_t */
+#include <threadless/allocation.h>
+
+/** Maximum number of size classes */
+#define SLAB_ALLOCATOR_MAX_CLASSES 64
+
+/** Maximum size class */
+#define SLAB_ALLOCATOR_MAX_SIZE (64 * 1024)
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/** Create a slab allocator instance
+ * @param[in,out] backing allocator used for the instance itself and for
+ *                        allocations larger than the largest size class
+ * @param[in]     sizes   strictly increasing size classes (or @c NULL for a
+ *                        default set of classes up to 4 KiB)
+ * @param         count   number of entries in @p sizes
+ * @retval non-NULL new allocator
+ * @retval NULL     error (check @c errno for reason)
+ * @post upon success, return value must be passed to allocator_destroy()
+ * @note Each size class keeps a freelist of objects carved from @c mmap(3)
+ *       slabs: allocation and free are O(1), and resizing within a class
+ *       neither moves nor copies memory. Sizes are rounded up to a multiple
+ *       of 16. Slabs are only released by allocator_destroy(). Aligned
+ *       allocation (allocation_realloc_aligned()) is not supported.
+ */
+allocator_t *slab_allocator_create(allocator_t *backing, const size_t *sizes,
+    size_t count);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* THREADLESS_SLAB_ALLOCATOR_H */
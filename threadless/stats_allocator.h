@@ -0,0 +1,83 @@
+/* threadless.io
+ * Copyright (c) 2016 Justin R. Cutler
+ * Licensed under the MIT License. See LICENSE file in the project root for
+ * full license information.
+ */
+/** @file
+ * instrumented (statistics-gathering) allocator interface definition
+ * @author Justin R. Cutler <justin.r.cutler@gmail.com>
+ */
+#ifndef THREADLESS_STATS_ALLOCATOR_H
+#define THREADLESS_STATS_ALLOCATOR_H
+
+/* CHAR_BIT */
+#include <limits.h>
+/* size_t */
+#include <stddef.h>
+
+/* allocator_t */
+#include <threadless/allocation.h>
+
+/** Number of size histogram buckets */
+#define STATS_ALLOCATOR_BUCKETS (sizeof(size_t) * CHAR_BIT)
+
+/** Allocator statistics */
+typedef struct {
+    /** Number of new allocations */
+    size_t allocations;
+    /** Number of reallocations to a larger size */
+    size_t grows;
+    /** Number of reallocations to a smaller size */
+    size_t shrinks;
+    /** Number of reallocations that did not move memory */
+    size_t in_place;
+    /** Number of frees */
+    size_t frees;
+    /** Number of failed requests */
+    size_t failures;
+    /** Number of live allocations */
+    size_t live_allocations;
+    /** Number of live bytes */
+    size_t live_bytes;
+    /** Maximum value of @p live_bytes */
+    size_t peak_bytes;
+    /** Number of (successful, non-zero) requests by size: bucket @c i counts
+     * sizes in [2^i, 2^(i+1))
+     */
+    size_t histogram[STATS_ALLOCATOR_BUCKETS];
+} allocator_stats_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/** Create an instrumented allocator instance
+ * @param[in,out] allocator allocator to wrap (and to allocate instance from)
+ * @retval non-NULL new allocator
+ * @retval NULL     error (check @c errno for reason)
+ * @post upon success, return value must be passed to allocator_destroy()
+ * @note Statistics are updated without locking; an instance must not be used
+ *       concurrently from multiple threads
+ */
+allocator_t *stats_allocator_create(allocator_t *allocator);
+
+/** Get statistics of an instrumented allocator
+ * @param[in]  allocator instrumented allocator instance
+ * @param[out] stats     statistics
+ * @pre @p allocator must have been returned by stats_allocator_create()
+ */
+void stats_allocator_snapshot(allocator_t *allocator, allocator_stats_t *stats);
+
+/** Reset statistics of an instrumented allocator
+ * @param[in,out] allocator instrumented allocator instance
+ * @pre @p allocator must have been returned by stats_allocator_create()
+ * @post All counters have been cleared, except for live allocations and
+ *       bytes; peak bytes has been set to live bytes
+ */
+void stats_allocator_reset(allocator_t *allocator);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* THREADLESS_STATS_ALLOCATOR_H */
@@ -0,0 +1,37 @@
+/* threadless.io
+ * Copyright (c) 2016 Justin R. Cutler
+ * Licensed under the MIT License. See LICENSE file in the project root for
+ * full license information.
+ */
+/** @file
+ * heap timer queue interface definition
+ * @author Justin R. Cutler <justin.r.cutler@gmail.com>
+ */
+#ifndef THREADLESS_TIMER_HEAP_H
+#define THREADLESS_TIMER_HEAP_H
+
+/* allocator_t */
+#include <threadless/allocation.h>
+/* timer_queue_t */
+#include <threadless/timer_queue.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/** Create a heap timer queue
+ * @param[in,out] allocator allocator to use for queue storage
+ * @retval non-NULL new timer queue
+ * @retval NULL     error (check @c errno for reason)
+ * @post upon success, return value must be passed to timer_queue_destroy()
+ * @note Timers are kept in a binary heap ordered by exact deadline: adding,
+ *       cancelling and refreshing are O(log n), finding the earliest deadline
+ *       is O(1). Suited to timers that usually expire (e.g., sleeps)
+ */
+timer_queue_t *timer_heap_create(allocator_t *allocator);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* THREADLESS_TIMER_HEAP_H */
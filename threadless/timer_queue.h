@@ -0,0 +1,226 @@
+/* threadless.io
+ * Copyright (c) 2016 Justin R. Cutler
+ * Licensed under the MIT License. See LICENSE file in the project root for
+ * full license information.
+ */
+/** @file
+ * timer queue interface definition
+ * @author Justin R. Cutler <justin.r.cutler@gmail.com>
+ */
+#ifndef THREADLESS_TIMER_QUEUE_H
+#define THREADLESS_TIMER_QUEUE_H
+
+/* bool, true, false */
+#include <stdbool.h>
+/* NULL, size_t */
+#include <stddef.h>
+/* uint64_t, UINT64_MAX */
+#include <stdint.h>
+
+/* heap_node_t */
+#include <threadless/heap.h>
+
+/** Timer type */
+typedef struct timer_event timer_event_t;
+
+/** Timer queue (timer store interface) type */
+typedef struct timer_queue timer_queue_t;
+
+/** Timer expiry function type
+ * @param[in,out] timer expired timer (no longer pending)
+ */
+typedef void (timer_function_t)(timer_event_t *timer);
+
+/** Timer structure (typically embedded in a larger structure) */
+struct timer_event {
+    /** timer store linkage (private to the store @c queue refers to) */
+    union {
+        /** heap node (see timer_heap_create()) */
+        heap_node_t node;
+        /** slot list links (see timer_wheel_create()) */
+        struct {
+            /** next timer in slot */
+            timer_event_t *next;
+            /** previous timer's @c next (or slot head) */
+            timer_event_t **prev;
+        } link;
+    } entry;
+    /** timer queue @c this is pending in (or @c NULL) */
+    timer_queue_t *queue;
+    /** expiry time (see timer_now()) */
+    uint64_t deadline;
+    /** expiry function */
+    timer_function_t *function;
+};
+
+/** Timer (re)scheduling function type
+ * @param[in,out] queue    timer queue
+ * @param[in,out] timer    timer (not pending, or pending in @p queue)
+ * @param         deadline expiry time (see timer_now())
+ * @retval 0  success
+ * @retval -1 error (check @c errno for reason)
+ */
+typedef int (timer_queue_add_function_t)(timer_queue_t *queue,
+    timer_event_t *timer, uint64_t deadline);
+
+/** Timer cancellation function type
+ * @param[in,out] queue timer queue
+ * @param[in,out] timer timer (pending in @p queue)
+ */
+typedef void (timer_queue_cancel_function_t)(timer_queue_t *queue,
+    timer_event_t *timer);
+
+/** Earliest deadline function type
+ * @param[in] queue timer queue
+ * @returns earliest deadline (or a lower bound), or @c UINT64_MAX if no timer
+ *          is pending
+ */
+typedef uint64_t (timer_queue_next_function_t)(const timer_queue_t *queue);
+
+/** Timer expiry function type
+ * @param[in,out] queue timer queue
+ * @param         now   current time (see timer_now())
+ * @returns number of expired timers
+ */
+typedef size_t (timer_queue_expire_function_t)(timer_queue_t *queue,
+    uint64_t now);
+
+/** Timer queue destructor function type
+ * @param[in,out] queue timer queue
+ */
+typedef void (timer_queue_destroy_function_t)(timer_queue_t *queue);
+
+/** Timer queue (timer store) interface */
+struct timer_queue {
+    /** Timer (re)scheduling function */
+    timer_queue_add_function_t *const add;
+    /** Timer cancellation function */
+    timer_queue_cancel_function_t *const cancel;
+    /** Earliest deadline function */
+    timer_queue_next_function_t *const next;
+    /** Timer expiry function */
+    timer_queue_expire_function_t *const expire;
+    /** Timer queue destructor */
+    timer_queue_destroy_function_t *const destroy;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/** Get the current monotonic time
+ * @returns current time (nanoseconds since an unspecified epoch)
+ */
+uint64_t timer_now(void);
+
+/** Test if a timer is pending
+ * @param[in] timer timer
+ * @retval true  @p timer is pending
+ * @retval false @p timer has expired, was cancelled or was never added
+ * @pre @p timer must have been initialized via timer_init()
+ */
+static inline bool timer_pending(const timer_event_t *timer)
+{
+    return NULL != timer->queue;
+}
+
+/** Initialize a timer
+ * @param[out] timer    timer
+ * @param      function function to call when @p timer expires
+ */
+static inline void timer_init(timer_event_t *timer,
+    timer_function_t *function)
+{
+    timer->queue = NULL;
+    timer->deadline = 0;
+    timer->function = function;
+}
+
+/** Cancel a pending timer
+ * @param[in,out] timer timer
+ * @post @p timer is not pending
+ * @note Cancelling a timer that is not pending has no effect
+ */
+static inline void timer_queue_cancel(timer_event_t *timer)
+{
+    if (timer_pending(timer)) {
+        timer->queue->cancel(timer->queue, timer);
+    }
+}
+
+/** Add a timer to a timer queue (or reschedule it)
+ * @param[in,out] queue    timer queue
+ * @param[in,out] timer    timer
+ * @param         deadline expiry time (see timer_now())
+ * @retval 0  success
+ * @retval -1 error (check @c errno for reason)
+ * @post Upon success, @p timer is pending in @p queue: @p timer->function
+ *       will be called by timer_queue_expire() once @p deadline has passed,
+ *       unless cancelled (or rescheduled) first
+ * @note A timer already pending in @p queue is rescheduled (see
+ *       timer_queue_refresh()); one pending in another queue is moved
+ */
+static inline int timer_queue_add(timer_queue_t *queue, timer_event_t *timer,
+    uint64_t deadline)
+{
+    if (timer->queue != queue) {
+        timer_queue_cancel(timer);
+    }
+    return queue->add(queue, timer, deadline);
+}
+
+/** Reschedule a pending timer within its timer queue
+ * @param[in,out] timer    timer (pending)
+ * @param         deadline new expiry time (see timer_now())
+ * @retval 0  success
+ * @retval -1 error (check @c errno for reason)
+ * @note This is the idle-timeout operation (e.g., on every packet received):
+ *       O(log n) with timer_heap_create(), O(1) with timer_wheel_create()
+ */
+static inline int timer_queue_refresh(timer_event_t *timer, uint64_t deadline)
+{
+    return timer->queue->add(timer->queue, timer, deadline);
+}
+
+/** Get the deadline of the earliest pending timer
+ * @param[in] queue timer queue
+ * @returns earliest deadline, or @c UINT64_MAX if no timer is pending
+ * @note Timer queues with a coarse resolution may return a lower bound
+ *       instead (calling timer_queue_expire() at that time refines it)
+ */
+static inline uint64_t timer_queue_next(const timer_queue_t *queue)
+{
+    return queue->next(queue);
+}
+
+/** Expire timers
+ * @param[in,out] queue timer queue
+ * @param         now   current time (see timer_now())
+ * @returns number of expired timers
+ * @post Timers whose deadline is at most @p now have been removed from
+ *       @p queue (earliest first, at the resolution of @p queue), and their
+ *       functions have been called
+ * @note Expiry functions may add and cancel timers. At most as many timers as
+ *       were pending upon entry expire per call, so an expiry function that
+ *       re-adds an expired timer cannot livelock the caller
+ */
+static inline size_t timer_queue_expire(timer_queue_t *queue, uint64_t now)
+{
+    return queue->expire(queue, now);
+}
+
+/** Destroy a timer queue
+ * @param[in,out] queue timer queue
+ * @post All pending timers have been cancelled (without expiring), and
+ *       @p queue may no longer be used
+ */
+static inline void timer_queue_destroy(timer_queue_t *queue)
+{
+    queue->destroy(queue);
+}
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* THREADLESS_TIMER_QUEUE_H */
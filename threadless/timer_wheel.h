@@ -0,0 +1,44 @@
+/* threadless.io
+ * Copyright (c) 2016 Justin R. Cutler
+ * Licensed under the MIT License. See LICENSE file in the project root for
+ * full license information.
+ */
+/** @file
+ * hierarchical timing wheel timer queue interface definition
+ * @author Justin R. Cutler <justin.r.cutler@gmail.com>
+ */
+#ifndef THREADLESS_TIMER_WHEEL_H
+#define THREADLESS_TIMER_WHEEL_H
+
+/* uint64_t */
+#include <stdint.h>
+
+/* allocator_t */
+#include <threadless/allocation.h>
+/* timer_queue_t */
+#include <threadless/timer_queue.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/** Create a hierarchical timing wheel timer queue
+ * @param[in,out] allocator  allocator used to create/destroy the queue
+ * @param         resolution tick length in nanoseconds (or 0 for 1ms)
+ * @retval non-NULL new timer queue
+ * @retval NULL     error (check @c errno for reason)
+ * @post upon success, return value must be passed to timer_queue_destroy()
+ * @note Adding, cancelling and refreshing are O(1) and never allocate;
+ *       timers cascade towards finer wheels as time advances. Deadlines are
+ *       rounded up to a whole tick, so timers expire up to one tick (plus the
+ *       lateness of timer_queue_expire() calls) after their deadline, never
+ *       before. Suited to timers that are usually refreshed or cancelled
+ *       before expiring (e.g., idle timeouts)
+ */
+timer_queue_t *timer_wheel_create(allocator_t *allocator, uint64_t resolution);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* THREADLESS_TIMER_WHEEL_H */